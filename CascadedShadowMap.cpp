@@ -0,0 +1,261 @@
+#include "CascadedShadowMap.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    float CascadedShadowMap::splitLambda = 0.75f;
+    bool CascadedShadowMap::cacheStatic = true;
+
+    GLuint CascadedShadowMap::CreateDepthArray(GLsizei resolution, int layers) {
+
+        GLuint depthArray;
+        glGenTextures(1, &depthArray);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, layers,
+            0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        //outside the map nothing is in shadow
+        float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        return depthArray;
+    }
+
+    void CascadedShadowMap::Init(int count, GLsizei size) {
+
+        cascadeCount = std::max(1, std::min(count, maxCascades));
+        resolution = size;
+
+        //a quarter of the cascade to spare on every side, within the texture size limit
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        staticResolution = std::max(resolution, std::min(resolution + resolution / 2, (GLsizei)maxSize));
+
+        texture = CreateDepthArray(resolution, cascadeCount);
+        staticTexture = CreateDepthArray(staticResolution, cascadeCount);
+
+        GLuint* framebuffers[] = { &framebuffer, &staticFramebuffer };
+        GLuint textures[] = { texture, staticTexture };
+        for (int i = 0; i < 2; i++) {
+
+            glGenFramebuffers(1, framebuffers[i]);
+            glBindFramebuffer(GL_FRAMEBUFFER, *framebuffers[i]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textures[i], 0, 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        InvalidateStatic();
+    }
+
+    void CascadedShadowMap::Release() {
+
+        glDeleteTextures(1, &texture);
+        glDeleteTextures(1, &staticTexture);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteFramebuffers(1, &staticFramebuffer);
+        texture = staticTexture = framebuffer = staticFramebuffer = 0;
+    }
+
+    void CascadedShadowMap::Update(const glm::mat4& view, const glm::mat4& projection, float cameraNear, float cameraFar,
+                                   float shadowDistance, const glm::mat4& lightView,
+                                   const glm::vec3& sceneMin, const glm::vec3& sceneMax) {
+
+        //world-space corners of the whole view frustum, near corner i pairs with far corner i
+        glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+        glm::vec3 nearCorners[4], farCorners[4];
+        for (int i = 0; i < 4; i++) {
+
+            float x = (i & 1) ? 1.0f : -1.0f;
+            float y = (i & 2) ? 1.0f : -1.0f;
+            glm::vec4 nearCorner = inverseViewProjection * glm::vec4(x, y, -1.0f, 1.0f);
+            glm::vec4 farCorner = inverseViewProjection * glm::vec4(x, y, 1.0f, 1.0f);
+            nearCorners[i] = glm::vec3(nearCorner) / nearCorner.w;
+            farCorners[i] = glm::vec3(farCorner) / farCorner.w;
+        }
+
+        //depth range of the static scene along the light - unlike the slices it
+        //does not follow the camera, so only turning the light changes it
+        float sceneNear = 0.0f;
+        float sceneFar = 0.0f;
+        for (int corner = 0; corner < 8; corner++) {
+
+            glm::vec3 point(corner & 1 ? sceneMax.x : sceneMin.x,
+                            corner & 2 ? sceneMax.y : sceneMin.y,
+                            corner & 4 ? sceneMax.z : sceneMin.z);
+            float distance = -(lightView * glm::vec4(point, 1.0f)).z;
+            sceneNear = corner == 0 ? distance : std::min(sceneNear, distance);
+            sceneFar = corner == 0 ? distance : std::max(sceneFar, distance);
+        }
+
+        float shadowFar = std::min(shadowDistance, cameraFar);
+        float splitNear = cameraNear;
+        for (int cascade = 0; cascade < cascadeCount; cascade++) {
+
+            float fraction = (float)(cascade + 1) / cascadeCount;
+            float uniformSplit = cameraNear + (shadowFar - cameraNear) * fraction;
+            float logSplit = cameraNear * std::pow(shadowFar / cameraNear, fraction);
+            float splitFar = uniformSplit + (logSplit - uniformSplit) * splitLambda;
+
+            //view depth is linear along the frustum edges
+            glm::vec3 sliceCorners[8];
+            glm::vec3 center(0.0f);
+            for (int i = 0; i < 4; i++) {
+
+                glm::vec3 edge = farCorners[i] - nearCorners[i];
+                sliceCorners[i] = nearCorners[i] + edge * ((splitNear - cameraNear) / (cameraFar - cameraNear));
+                sliceCorners[i + 4] = nearCorners[i] + edge * ((splitFar - cameraNear) / (cameraFar - cameraNear));
+                center += sliceCorners[i] + sliceCorners[i + 4];
+            }
+            center /= 8.0f;
+
+            float radius = 0.0f;
+            for (int i = 0; i < 8; i++)
+                radius = std::max(radius, glm::length(sliceCorners[i] - center));
+            //rounded so float noise does not change the texel size between frames
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            //the box starts on a whole texel, counted from the light-space origin
+            float texelSize = 2.0f * radius / resolution;
+            glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+            int x = (int)std::floor(lightCenter.x / texelSize) - resolution / 2;
+            int y = (int)std::floor(lightCenter.y / texelSize) - resolution / 2;
+            if (x != cascadeX[cascade] || y != cascadeY[cascade])
+                layerIsStatic[cascade] = false;
+            cascadeX[cascade] = x;
+            cascadeY[cascade] = y;
+
+            gps::ShadowCascade& shadowCascade = cascades[cascade];
+            shadowCascade.left = x * texelSize;
+            shadowCascade.right = (x + resolution) * texelSize;
+            shadowCascade.bottom = y * texelSize;
+            shadowCascade.top = (y + resolution) * texelSize;
+            shadowCascade.farPlane = sceneFar;
+            shadowCascade.nearPlane = sceneNear;
+            shadowCascade.lightSpaceTrMatrix = glm::ortho(shadowCascade.left, shadowCascade.right,
+                shadowCascade.bottom, shadowCascade.top, shadowCascade.nearPlane, shadowCascade.farPlane) * lightView;
+            shadowCascade.splitDepth = splitFar;
+            shadowCascade.depthBias = 1.5f * texelSize / (shadowCascade.farPlane - shadowCascade.nearPlane);
+
+            //the static window stays put while the cascade is inside it
+            StaticWindow& window = staticWindows[cascade];
+            bool fits = window.texelSize == texelSize && window.nearPlane == sceneNear && window.farPlane == sceneFar &&
+                memcmp(&window.lightView, &lightView, sizeof(glm::mat4)) == 0 &&
+                x >= window.x && x + resolution <= window.x + staticResolution &&
+                y >= window.y && y + resolution <= window.y + staticResolution;
+            if (!fits) {
+
+                GLsizei margin = (staticResolution - resolution) / 2;
+                window.lightView = lightView;
+                window.texelSize = texelSize;
+                window.nearPlane = sceneNear;
+                window.farPlane = sceneFar;
+                window.x = x - margin;
+                window.y = y - margin;
+                window.valid = false;
+                window.lightSpaceTrMatrix = glm::ortho(window.x * texelSize, (window.x + staticResolution) * texelSize,
+                    window.y * texelSize, (window.y + staticResolution) * texelSize, sceneNear, sceneFar) * lightView;
+                layerIsStatic[cascade] = false;
+            }
+
+            splitNear = splitFar;
+        }
+    }
+
+    void CascadedShadowMap::InvalidateStatic() {
+
+        for (int cascade = 0; cascade < maxCascades; cascade++) {
+
+            staticWindows[cascade].valid = false;
+            layerIsStatic[cascade] = false;
+        }
+    }
+
+    bool CascadedShadowMap::StaticNeedsUpdate(int cascade) const {
+
+        return !cacheStatic || !staticWindows[cascade].valid;
+    }
+
+    const glm::mat4& CascadedShadowMap::GetStaticMatrix(int cascade) const {
+
+        return staticWindows[cascade].lightSpaceTrMatrix;
+    }
+
+    void CascadedShadowMap::BeginStaticCascade(int cascade) {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, staticFramebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, cascade);
+        glViewport(0, 0, staticResolution, staticResolution);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        //without the cache the casters are culled to this frame's receivers, so the layer is not reusable
+        staticWindows[cascade].valid = cacheStatic;
+        layerIsStatic[cascade] = false;
+    }
+
+    bool CascadedShadowMap::BeginDynamicCascade(int cascade, bool hasDynamicCasters) {
+
+        if (!hasDynamicCasters && layerIsStatic[cascade])
+            return false;
+
+        //same texel grid and depth range, so the copy is a whole-texel offset
+        GLint x = cascadeX[cascade] - staticWindows[cascade].x;
+        GLint y = cascadeY[cascade] - staticWindows[cascade].y;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, cascade);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+        glBlitFramebuffer(x, y, x + resolution, y + resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        layerIsStatic[cascade] = !hasDynamicCasters;
+        if (!hasDynamicCasters)
+            return false;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, resolution, resolution);
+        return true;
+    }
+
+    void CascadedShadowMap::End() {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    const gps::ShadowCascade& CascadedShadowMap::GetCascade(int cascade) const {
+
+        return cascades[cascade];
+    }
+
+    int CascadedShadowMap::GetCascadeCount() const {
+
+        return cascadeCount;
+    }
+
+    GLsizei CascadedShadowMap::GetResolution() const {
+
+        return resolution;
+    }
+
+    GLuint CascadedShadowMap::GetTexture() const {
+
+        return texture;
+    }
+
+    size_t CascadedShadowMap::GetMemorySize() const {
+
+        //sampled layers and the larger static cache
+        return ((size_t)resolution * resolution + (size_t)staticResolution * staticResolution) * cascadeCount * sizeof(float);
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef CascadedShadowMap_hpp
+#define CascadedShadowMap_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+namespace gps {
+
+    struct ShadowCascade {
+
+        glm::mat4 lightSpaceTrMatrix;
+        // orthographic box in light view space; near and far are distances along the light
+        float left;
+        float right;
+        float bottom;
+        float top;
+        float nearPlane;
+        float farPlane;
+        // view-space depth where the next cascade takes over
+        float splitDepth;
+        // about one and a half texels, in [0, 1] depth units
+        float depthBias;
+    };
+
+    // Directional light shadows split into cascades along the camera view
+    // depth, one layer each in a depth texture array.
+    //
+    // Split depths blend uniform and logarithmic spacing. Every cascade is
+    // an orthographic box around the bounding sphere of its frustum slice;
+    // the sphere does not change size as the camera turns and the box is
+    // snapped to whole texels, so shadow edges do not swim. The box extends
+    // toward the light to the nearest scene point, keeping casters outside
+    // the slice.
+    //
+    // Static casters are rendered into a second, larger texture array: each
+    // layer is a window on the cascade's texel grid with a quarter of the
+    // cascade to spare on every side. The window does not follow the camera
+    // - it is re-centred, and re-rendered, only when the cascade leaves it,
+    // the light turns or InvalidateStatic is called. Each frame the part
+    // under the cascade is blitted into the sampled layer, a whole number of
+    // texels in, and the dynamic casters are drawn on top; layers with no
+    // dynamic casters that already hold the static depth are left alone.
+    class CascadedShadowMap {
+
+    public:
+        static const int maxCascades = 4;
+        // 0 - uniform splits, 1 - logarithmic splits
+        static float splitLambda;
+        // Reuse static depth between frames; off re-renders it every frame
+        static bool cacheStatic;
+
+        // Creates the depth texture array and the framebuffer
+        void Init(int cascadeCount, GLsizei resolution);
+
+        void Release();
+
+        // Fits the cascades to the camera frustum up to shadowDistance. Only x
+        // and y follow the camera, snapped to texels; depth spans the static
+        // scene bounds, so dynamic casters outside them need GL_DEPTH_CLAMP.
+        // Moves the static windows the cascades left.
+        void Update(const glm::mat4& view, const glm::mat4& projection, float cameraNear, float cameraFar,
+                    float shadowDistance, const glm::mat4& lightView, const glm::vec3& sceneMin, const glm::vec3& sceneMax);
+
+        // Forgets the cached static depth - call when static casters change
+        void InvalidateStatic();
+
+        // True when the static layer of the cascade has to be rendered this frame
+        bool StaticNeedsUpdate(int cascade) const;
+
+        // Light view-projection of the cascade's static window, to render and
+        // cull the static casters with
+        const glm::mat4& GetStaticMatrix(int cascade) const;
+
+        // Renders static casters into the cache: binds its layer, sets the viewport and clears it
+        void BeginStaticCascade(int cascade);
+
+        // Copies the static depth into the sampled layer unless it is already
+        // there. Returns true, with that layer bound, when the dynamic casters
+        // have to be drawn over it.
+        bool BeginDynamicCascade(int cascade, bool hasDynamicCasters);
+
+        // Rebinds the default framebuffer
+        void End();
+
+        const gps::ShadowCascade& GetCascade(int cascade) const;
+        int GetCascadeCount() const;
+        GLsizei GetResolution() const;
+        GLuint GetTexture() const;
+
+        // Bytes of depth texture memory
+        size_t GetMemorySize() const;
+
+    private:
+        struct StaticWindow {
+
+            glm::mat4 lightView;
+            glm::mat4 lightSpaceTrMatrix;
+            float texelSize;
+            float nearPlane;
+            float farPlane;
+            // lower-left texel on the cascade's texel grid
+            int x;
+            int y;
+            // the cached layer holds this window
+            bool valid;
+        };
+
+        gps::ShadowCascade cascades[maxCascades];
+        // lower-left texel of each cascade on its texel grid
+        int cascadeX[maxCascades] = {};
+        int cascadeY[maxCascades] = {};
+        int cascadeCount = 0;
+        GLsizei resolution = 0;
+        GLsizei staticResolution = 0;
+        GLuint framebuffer = 0;
+        GLuint texture = 0;
+        GLuint staticFramebuffer = 0;
+        GLuint staticTexture = 0;
+
+        StaticWindow staticWindows[maxCascades] = {};
+        // the sampled layer holds exactly the static depth under the cascade
+        bool layerIsStatic[maxCascades] = {};
+
+        static GLuint CreateDepthArray(GLsizei resolution, int layers);
+    };
+}
+
+#endif /* CascadedShadowMap_hpp */
@@ -0,0 +1,64 @@
+#include "Frustum.hpp"
+
+namespace gps {
+
+    Frustum::Frustum() {
+
+        for (int i = 0; i < 6; i++)
+            planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    Frustum::Frustum(const glm::mat4& viewProjection) {
+
+        //glm is column-major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        planes[0] = rows[3] + rows[0];
+        planes[1] = rows[3] - rows[0];
+        planes[2] = rows[3] + rows[1];
+        planes[3] = rows[3] - rows[1];
+        planes[4] = rows[3] + rows[2];
+        planes[5] = rows[3] - rows[2];
+
+        for (int i = 0; i < 6; i++)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const {
+
+        for (int i = 0; i < 6; i++)
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+                return false;
+        return true;
+    }
+
+    gps::FrustumTest Frustum::TestAABB(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const {
+
+        gps::FrustumTest result = FRUSTUM_INSIDE;
+        for (int i = 0; i < 6; i++) {
+
+            glm::vec3 normal = glm::vec3(planes[i]);
+
+            //corner furthest along the normal, and the one furthest against it
+            glm::vec3 positive, negative;
+            for (int c = 0; c < 3; c++) {
+
+                positive[c] = normal[c] >= 0.0f ? aabbMax[c] : aabbMin[c];
+                negative[c] = normal[c] >= 0.0f ? aabbMin[c] : aabbMax[c];
+            }
+
+            if (glm::dot(normal, positive) + planes[i].w < 0.0f)
+                return FRUSTUM_OUTSIDE;
+            if (glm::dot(normal, negative) + planes[i].w < 0.0f)
+                result = FRUSTUM_INTERSECTS;
+        }
+        return result;
+    }
+
+    const glm::vec4& Frustum::GetPlane(int index) const {
+
+        return planes[index];
+    }
+}
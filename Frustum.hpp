@@ -0,0 +1,38 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include <glm/glm.hpp>
+
+namespace gps {
+
+    enum FrustumTest {
+
+        FRUSTUM_OUTSIDE,
+        FRUSTUM_INTERSECTS,
+        FRUSTUM_INSIDE
+    };
+
+    // Six planes (left, right, bottom, top, near, far) pointing inwards,
+    // extracted from a view-projection matrix
+    class Frustum {
+
+    public:
+        Frustum();
+
+        // Gribb/Hartmann extraction - planes of the clip volume in the space
+        // the matrix transforms from (world space for projection * view)
+        explicit Frustum(const glm::mat4& viewProjection);
+
+        bool IntersectsSphere(const glm::vec3& center, float radius) const;
+
+        gps::FrustumTest TestAABB(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const;
+
+        const glm::vec4& GetPlane(int index) const;
+
+    private:
+        // xyz is the unit normal, w the distance
+        glm::vec4 planes[6];
+    };
+}
+
+#endif /* Frustum_hpp */
@@ -0,0 +1,107 @@
+#include "GBuffer.hpp"
+
+#include <cstdio>
+
+namespace gps {
+
+    GLuint GBuffer::CreateTarget(GLenum internalFormat, GLenum format, GLenum type, GLsizei width, GLsizei height) {
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+
+        //read one texel per pixel
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    void GBuffer::Init(GLsizei width, GLsizei height) {
+
+        Release();
+        this->width = width;
+        this->height = height;
+
+        albedoTexture = CreateTarget(GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+        normalTexture = CreateTarget(GL_RG16F, GL_RG, GL_HALF_FLOAT, width, height);
+        depthTexture = CreateTarget(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            fprintf(stderr, "GBuffer: framebuffer incomplete at %dx%d\n", width, height);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void GBuffer::Release() {
+
+        if (framebuffer == 0)
+            return;
+
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &albedoTexture);
+        glDeleteTextures(1, &normalTexture);
+        glDeleteTextures(1, &depthTexture);
+        framebuffer = albedoTexture = normalTexture = depthTexture = 0;
+    }
+
+    void GBuffer::Begin() {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+
+        //leaves the clear colour of the default framebuffer alone
+        const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClearBufferfv(GL_COLOR, 1, zero);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    void GBuffer::End() {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void GBuffer::BindTextures(gps::Shader& shader) const {
+
+        shader.useShaderProgram();
+
+        const GLuint textures[3] = { albedoTexture, normalTexture, depthTexture };
+        const int units[3] = { albedoUnit, normalUnit, depthUnit };
+        const char* const names[3] = { "gAlbedo", "gNormal", "gDepth" };
+
+        for (int i = 0; i < 3; i++) {
+
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glUniform1i(shader.getUniformLocation(names[i]), units[i]);
+        }
+    }
+
+    GLsizei GBuffer::GetWidth() const {
+
+        return width;
+    }
+
+    GLsizei GBuffer::GetHeight() const {
+
+        return height;
+    }
+
+    size_t GBuffer::GetMemorySize() const {
+
+        return (size_t)width * height * (4 + 4 + 4);
+    }
+}
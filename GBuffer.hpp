@@ -0,0 +1,60 @@
+#ifndef GBuffer_hpp
+#define GBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Shader.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    // Render targets of the deferred path: albedo with the specular mask in
+    // alpha (sRGB, 4 bytes), the eye-space normal octahedron-encoded into two
+    // half floats and the depth buffer, from which the lighting pass rebuilds
+    // positions. 12 bytes a pixel.
+    class GBuffer {
+
+    public:
+        // texture units the lighting pass reads the targets from
+        static const int albedoUnit = 0;
+        static const int normalUnit = 1;
+        static const int depthUnit = 2;
+
+        // Creates the targets, replacing any of a previous size
+        void Init(GLsizei width, GLsizei height);
+
+        void Release();
+
+        // Binds and clears the targets for the geometry pass
+        void Begin();
+
+        // Back to the default framebuffer
+        void End();
+
+        // Binds the targets to their units and the samplers of the lighting program
+        void BindTextures(gps::Shader& shader) const;
+
+        GLsizei GetWidth() const;
+        GLsizei GetHeight() const;
+        size_t GetMemorySize() const;
+
+    private:
+        GLuint framebuffer = 0;
+        GLuint albedoTexture = 0;
+        GLuint normalTexture = 0;
+        GLuint depthTexture = 0;
+        GLsizei width = 0;
+        GLsizei height = 0;
+
+        static GLuint CreateTarget(GLenum internalFormat, GLenum format, GLenum type, GLsizei width, GLsizei height);
+    };
+}
+
+#endif /* GBuffer_hpp */
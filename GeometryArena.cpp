@@ -0,0 +1,180 @@
+#include "GeometryArena.hpp"
+#include "InstanceBuffer.hpp"
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace gps {
+
+    namespace {
+
+        //room for a few medium models before the first grow
+        const size_t INITIAL_VERTICES = 256 * 1024;
+        const size_t INITIAL_INDICES = 1024 * 1024;
+    }
+
+    bool GeometryArena::enabled = true;
+
+    GeometryArena& GeometryArena::Instance() {
+
+        static GeometryArena instance(false);
+        return instance;
+    }
+
+    GeometryArena& GeometryArena::DepthInstance() {
+
+        static GeometryArena instance(true);
+        return instance;
+    }
+
+    gps::ArenaRange GeometryArena::Allocate(const void* vertexData, size_t vertices, bool packedData,
+                                            const GLuint* indexData, size_t indices) {
+
+        if (vao == 0) {
+
+            packed = packedData;
+            if (positionsOnly)
+                stride = packed ? sizeof(gps::PackedVertex::Position) : sizeof(gps::Vertex::Position);
+            else
+                stride = packed ? sizeof(gps::PackedVertex) : sizeof(gps::Vertex);
+
+            glGenVertexArrays(1, &vao);
+            glGenBuffers(1, &vertexBuffer);
+            glGenBuffers(1, &indexBuffer);
+        }
+
+        if (packedData != packed)
+            fprintf(stderr, "GeometryArena: mixed vertex layouts, mesh drawn with the wrong format\n");
+
+        bool grown = false;
+        if (vertexCount + vertices > vertexCapacity) {
+
+            size_t capacity = std::max(vertexCapacity * 2, std::max(INITIAL_VERTICES, vertexCount + vertices));
+            Grow(vertexBuffer, vertexCount * stride, capacity * stride);
+            vertexCapacity = capacity;
+            grown = true;
+        }
+        if (indexCount + indices > indexCapacity) {
+
+            size_t capacity = std::max(indexCapacity * 2, std::max(INITIAL_INDICES, indexCount + indices));
+            Grow(indexBuffer, indexCount * sizeof(GLuint), capacity * sizeof(GLuint));
+            indexCapacity = capacity;
+            grown = true;
+        }
+
+        //new buffer names - every VAO has to be pointed at them again
+        if (grown) {
+
+            glBindVertexArray(vao);
+            BindVertexAttributes();
+            for (auto& instanced : instancedVAOs) {
+
+                glBindVertexArray(instanced.second);
+                BindVertexAttributes();
+            }
+            glBindVertexArray(0);
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, vertexCount * stride, vertices * stride, vertexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(GLuint), indices * sizeof(GLuint), indexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        gps::ArenaRange range;
+        range.baseVertex = (GLint)vertexCount;
+        range.firstIndex = (GLuint)indexCount;
+
+        vertexCount += vertices;
+        indexCount += indices;
+        return range;
+    }
+
+    void GeometryArena::Grow(GLuint& buffer, size_t used, size_t capacity) {
+
+        GLuint grownBuffer;
+        glGenBuffers(1, &grownBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grownBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+
+        if (used > 0) {
+
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &buffer);
+        buffer = grownBuffer;
+    }
+
+    void GeometryArena::BindVertexAttributes() const {
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+        //same layouts as Mesh::setupMesh and Mesh::setupDepthStream
+        if (positionsOnly) {
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, packed ? GL_UNSIGNED_SHORT : GL_FLOAT, packed ? GL_TRUE : GL_FALSE, stride, (GLvoid*)0);
+        }
+        else if (packed) {
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, Position));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, Normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(PackedVertex, TexCoords));
+        }
+        else {
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, Position));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, Normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, TexCoords));
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    GLuint GeometryArena::GetVAO() const {
+
+        return vao;
+    }
+
+    GLuint GeometryArena::GetInstancedVAO(const gps::InstanceBuffer& instances) {
+
+        auto found = instancedVAOs.find(instances.GetBuffer());
+        if (found != instancedVAOs.end())
+            return found->second;
+
+        GLuint instancedVAO;
+        glGenVertexArrays(1, &instancedVAO);
+        glBindVertexArray(instancedVAO);
+        BindVertexAttributes();
+        instances.BindAttributes();
+        glBindVertexArray(0);
+
+        instancedVAOs[instances.GetBuffer()] = instancedVAO;
+        return instancedVAO;
+    }
+
+    void GeometryArena::Release() {
+
+        for (auto& instanced : instancedVAOs)
+            glDeleteVertexArrays(1, &instanced.second);
+        instancedVAOs.clear();
+
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+        vao = vertexBuffer = indexBuffer = 0;
+        vertexCount = vertexCapacity = indexCount = indexCapacity = 0;
+    }
+}
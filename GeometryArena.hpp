@@ -0,0 +1,89 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstddef>
+#include <unordered_map>
+
+namespace gps {
+
+    class InstanceBuffer;
+
+    // Where a mesh lives inside the arena buffers
+    struct ArenaRange {
+
+        // added to every index of the mesh
+        GLint baseVertex;
+        // offset of the first index, in indices
+        GLuint firstIndex;
+    };
+
+    // Process-wide vertex and index buffers that every mesh is suballocated
+    // from, so the whole scene draws from one VAO and consecutive draws can be
+    // merged into a single glMultiDrawElementsIndirect.
+    //
+    // Allocation is append-only - meshes stay for the life of the program.
+    // The buffers double when full; meshes only keep offsets, so growing
+    // just points the VAOs at the new buffers.
+    //
+    // A second arena holds the position-only streams of Mesh for the depth
+    // passes; its vertices are just the Position member of either layout.
+    class GeometryArena {
+
+    public:
+        // Give every mesh its own VAO/VBO/EBO instead
+        static bool enabled;
+
+        static GeometryArena& Instance();
+
+        // Arena of position-only vertices, read through attribute 0 only
+        static GeometryArena& DepthInstance();
+
+        // Copies the vertices and indices of a mesh into the arena. The vertex
+        // layout (Vertex or PackedVertex) is fixed by the first allocation.
+        gps::ArenaRange Allocate(const void* vertexData, size_t vertices, bool packedData,
+                                 const GLuint* indexData, size_t indices);
+
+        // VAO over the arena buffers shared by all non-instanced draws
+        GLuint GetVAO() const;
+
+        // VAO over the arena buffers that also reads the instance attributes
+        // of instances - one per instance buffer, created on first use
+        GLuint GetInstancedVAO(const gps::InstanceBuffer& instances);
+
+        // Deletes the GL objects - call before the context is destroyed
+        void Release();
+
+    private:
+        GLuint vao = 0;
+        GLuint vertexBuffer = 0;
+        GLuint indexBuffer = 0;
+        // instance buffer -> VAO reading it
+        std::unordered_map<GLuint, GLuint> instancedVAOs;
+
+        bool positionsOnly;
+        bool packed = false;
+        GLsizei stride = 0;
+        size_t vertexCount = 0;
+        size_t vertexCapacity = 0;
+        size_t indexCount = 0;
+        size_t indexCapacity = 0;
+
+        explicit GeometryArena(bool positionsOnly) : positionsOnly(positionsOnly) {}
+
+        // Reallocates buffer with room for capacity bytes, keeping the first used bytes
+        static void Grow(GLuint& buffer, size_t used, size_t capacity);
+
+        // Points the vertex attributes and element buffer of the bound VAO at the arena
+        void BindVertexAttributes() const;
+    };
+}
+
+#endif /* GeometryArena_hpp */
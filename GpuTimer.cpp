@@ -0,0 +1,78 @@
+#include "GpuTimer.hpp"
+
+namespace gps {
+
+    void GpuTimer::Begin() {
+
+        if (queries[0] == 0)
+            glGenQueries(latency, queries);
+
+        Collect(pending == latency);
+        glBeginQuery(target, queries[next]);
+    }
+
+    void GpuTimer::End() {
+
+        glEndQuery(target);
+        next = (next + 1) % latency;
+        pending++;
+    }
+
+    void GpuTimer::Finish() {
+
+        while (pending > 0)
+            Collect(true);
+    }
+
+    void GpuTimer::Collect(bool wait) {
+
+        while (pending > 0) {
+
+            GLuint query = queries[(next - pending + latency) % latency];
+
+            GLint available = GL_FALSE;
+            if (wait)
+                available = GL_TRUE;
+            else
+                glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+
+            //nanoseconds for GL_TIME_ELAPSED
+            GLuint64 result = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+            last = target == GL_TIME_ELAPSED ? result / 1.0e6 : (double)result;
+            total += last;
+            results++;
+            pending--;
+
+            //only the oldest result is worth waiting for
+            wait = false;
+        }
+    }
+
+    double GpuTimer::GetLast() const {
+
+        return last;
+    }
+
+    double GpuTimer::GetAverage() const {
+
+        return results > 0 ? total / results : 0.0;
+    }
+
+    void GpuTimer::ResetAverage() {
+
+        total = 0.0;
+        results = 0;
+    }
+
+    void GpuTimer::Release() {
+
+        if (queries[0] != 0)
+            glDeleteQueries(latency, queries);
+        for (int i = 0; i < latency; i++)
+            queries[i] = 0;
+        next = pending = 0;
+    }
+}
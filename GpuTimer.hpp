@@ -0,0 +1,61 @@
+#ifndef GpuTimer_hpp
+#define GpuTimer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+namespace gps {
+
+    // GPU time of a span of commands, measured with GL_TIME_ELAPSED queries,
+    // or with GL_SAMPLES_PASSED the number of samples that passed the depth
+    // test in it.
+    //
+    // Results are read a few frames late from a ring of queries so the CPU
+    // never waits for the GPU; only when every query is still in flight does
+    // Begin block on the oldest one. Spans of the same target must not nest -
+    // GL allows one active query per target.
+    class GpuTimer {
+
+    public:
+        // queries in flight before Begin has to wait for a result
+        static const int latency = 4;
+
+        explicit GpuTimer(GLenum target = GL_TIME_ELAPSED) : target(target) {}
+
+        void Begin();
+        void End();
+
+        // Blocks until every pending query has its result
+        void Finish();
+
+        // Milliseconds - or samples - of the most recent finished span, 0 until one finishes
+        double GetLast() const;
+
+        // Mean over the spans finished since ResetAverage
+        double GetAverage() const;
+        void ResetAverage();
+
+        // Deletes the queries - call before the context is destroyed
+        void Release();
+
+    private:
+        GLenum target;
+        GLuint queries[latency] = {};
+        int next = 0;
+        int pending = 0;
+
+        double last = 0.0;
+        double total = 0.0;
+        unsigned results = 0;
+
+        // Reads finished queries, oldest first; wait blocks on the oldest one
+        void Collect(bool wait);
+    };
+}
+
+#endif /* GpuTimer_hpp */
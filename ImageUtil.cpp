@@ -0,0 +1,143 @@
+#include "ImageUtil.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define GPS_FLIP_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+#endif
+
+namespace gps {
+
+    namespace {
+
+        void swapRows(unsigned char* top, unsigned char* bottom, size_t rowBytes) {
+
+            size_t i = 0;
+
+#if defined(__AVX2__)
+            for (; i + 32 <= rowBytes; i += 32) {
+
+                __m256i a = _mm256_loadu_si256((const __m256i*)(top + i));
+                __m256i b = _mm256_loadu_si256((const __m256i*)(bottom + i));
+                _mm256_storeu_si256((__m256i*)(top + i), b);
+                _mm256_storeu_si256((__m256i*)(bottom + i), a);
+            }
+#elif defined(GPS_FLIP_SSE2)
+            for (; i + 16 <= rowBytes; i += 16) {
+
+                __m128i a = _mm_loadu_si128((const __m128i*)(top + i));
+                __m128i b = _mm_loadu_si128((const __m128i*)(bottom + i));
+                _mm_storeu_si128((__m128i*)(top + i), b);
+                _mm_storeu_si128((__m128i*)(bottom + i), a);
+            }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+            for (; i + 16 <= rowBytes; i += 16) {
+
+                uint8x16_t a = vld1q_u8(top + i);
+                uint8x16_t b = vld1q_u8(bottom + i);
+                vst1q_u8(top + i, b);
+                vst1q_u8(bottom + i, a);
+            }
+#endif
+
+            for (; i + 8 <= rowBytes; i += 8) {
+
+                uint64_t a, b;
+                memcpy(&a, top + i, 8);
+                memcpy(&b, bottom + i, 8);
+                memcpy(top + i, &b, 8);
+                memcpy(bottom + i, &a, 8);
+            }
+
+            for (; i < rowBytes; i++) {
+
+                unsigned char temp = top[i];
+                top[i] = bottom[i];
+                bottom[i] = temp;
+            }
+        }
+
+        float srgbToLinear(float value) {
+
+            value /= 255.0f;
+            return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+        }
+
+        float linearToSrgb(float value) {
+
+            value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+            return value * 255.0f;
+        }
+    }
+
+    void FlipRowsVertical(unsigned char* pixels, size_t rowBytes, size_t rows) {
+
+        for (size_t row = 0; row < rows / 2; row++)
+            swapRows(pixels + row * rowBytes, pixels + (rows - row - 1) * rowBytes, rowBytes);
+    }
+
+    void CopyRowsFlipped(unsigned char* dst, const unsigned char* src, size_t rowBytes, size_t rows,
+        size_t begin, size_t end) {
+
+        while (begin < end) {
+
+            size_t row = begin / rowBytes;
+            size_t column = begin % rowBytes;
+            size_t count = rowBytes - column;
+            if (count > end - begin)
+                count = end - begin;
+
+            memcpy(dst + begin, src + (rows - row - 1) * rowBytes + column, count);
+            begin += count;
+        }
+    }
+
+    std::vector<unsigned char> Downsample(const unsigned char* rgba, uint32_t width, uint32_t height, bool srgb) {
+
+        uint32_t newWidth = std::max(1u, width / 2);
+        uint32_t newHeight = std::max(1u, height / 2);
+        std::vector<unsigned char> result((size_t)newWidth * newHeight * 4);
+
+        float toLinear[256];
+        for (int i = 0; i < 256; i++)
+            toLinear[i] = srgb ? srgbToLinear((float)i) : (float)i;
+
+        for (uint32_t y = 0; y < newHeight; y++) {
+
+            for (uint32_t x = 0; x < newWidth; x++) {
+
+                for (int c = 0; c < 4; c++) {
+
+                    float sum = 0.0f;
+                    for (uint32_t dy = 0; dy < 2; dy++) {
+
+                        for (uint32_t dx = 0; dx < 2; dx++) {
+
+                            uint32_t sx = std::min(x * 2 + dx, width - 1);
+                            uint32_t sy = std::min(y * 2 + dy, height - 1);
+                            unsigned char value = rgba[((size_t)sy * width + sx) * 4 + c];
+                            //alpha is always linear
+                            sum += c < 3 ? toLinear[value] : (float)value;
+                        }
+                    }
+
+                    float average = sum / 4.0f;
+                    if (srgb && c < 3)
+                        average = linearToSrgb(average);
+                    result[((size_t)y * newWidth + x) * 4 + c] =
+                        (unsigned char)std::lround(std::min(std::max(average, 0.0f), 255.0f));
+                }
+            }
+        }
+
+        return result;
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef ImageUtil_hpp
+#define ImageUtil_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Flips an image vertically in place by swapping rows with the widest
+    // vector unit available at compile time (AVX2, SSE2 or NEON), falling
+    // back to scalar code for the row tails and other targets.
+    void FlipRowsVertical(unsigned char* pixels, size_t rowBytes, size_t rows);
+
+    // Writes bytes [begin, end) of the vertically flipped image into dst,
+    // reading from the unflipped src. Lets a staging copy flip for free.
+    void CopyRowsFlipped(unsigned char* dst, const unsigned char* src, size_t rowBytes, size_t rows,
+        size_t begin, size_t end);
+
+    // Halves an RGBA8 image with a 2x2 box filter. With srgb set the average
+    // is taken in linear space.
+    std::vector<unsigned char> Downsample(const unsigned char* rgba, uint32_t width, uint32_t height, bool srgb);
+}
+
+#endif /* ImageUtil_hpp */
@@ -0,0 +1,67 @@
+#include "InstanceBuffer.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    InstanceBuffer::~InstanceBuffer() {
+
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+    }
+
+    void InstanceBuffer::Upload(const std::vector<gps::InstanceData>& instances) {
+
+        if (buffer == 0)
+            glGenBuffers(1, &buffer);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+        size_t bytes = instances.size() * sizeof(gps::InstanceData);
+        if (bytes > capacity) {
+
+            glBufferData(GL_ARRAY_BUFFER, bytes, instances.data(), GL_DYNAMIC_DRAW);
+            capacity = bytes;
+        }
+        else if (bytes > 0) {
+
+            //orphan the old storage so frames still using it do not stall the upload
+            glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        count = (GLsizei)instances.size();
+    }
+
+    void InstanceBuffer::BindAttributes() const {
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+        //a mat4 attribute takes four consecutive locations, one per column
+        for (GLuint column = 0; column < 4; column++) {
+
+            glEnableVertexAttribArray(modelAttribute + column);
+            glVertexAttribPointer(modelAttribute + column, 4, GL_FLOAT, GL_FALSE, sizeof(gps::InstanceData),
+                (GLvoid*)(offsetof(gps::InstanceData, model) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(modelAttribute + column, 1);
+        }
+
+        glEnableVertexAttribArray(liveryAttribute);
+        glVertexAttribPointer(liveryAttribute, 1, GL_FLOAT, GL_FALSE, sizeof(gps::InstanceData),
+            (GLvoid*)offsetof(gps::InstanceData, livery));
+        glVertexAttribDivisor(liveryAttribute, 1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    GLuint InstanceBuffer::GetBuffer() const {
+
+        return buffer;
+    }
+
+    GLsizei InstanceBuffer::GetCount() const {
+
+        return count;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef InstanceBuffer_hpp
+#define InstanceBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Per-instance data read by the instanced vertex shaders
+    struct InstanceData {
+
+        glm::mat4 model;
+        // index into the liveryTints palette
+        float livery;
+        float padding[3];
+    };
+
+    // GL buffer of InstanceData, attached to mesh VAOs as attributes 3-6
+    // (model matrix columns) and 7 (livery) with a divisor of 1
+    class InstanceBuffer {
+
+    public:
+        static const GLuint modelAttribute = 3;
+        static const GLuint liveryAttribute = 7;
+
+        ~InstanceBuffer();
+
+        // Replaces the contents, growing the buffer when needed
+        void Upload(const std::vector<gps::InstanceData>& instances);
+
+        // Points the instance attributes of the bound VAO at this buffer
+        void BindAttributes() const;
+
+        GLuint GetBuffer() const;
+        GLsizei GetCount() const;
+
+    private:
+        GLuint buffer = 0;
+        GLsizei count = 0;
+        size_t capacity = 0;
+    };
+}
+
+#endif /* InstanceBuffer_hpp */
@@ -0,0 +1,188 @@
+#include "Ktx2.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+    namespace {
+
+        const unsigned char KTX2_IDENTIFIER[12] = {
+            0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+        };
+
+        struct Ktx2Header {
+
+            unsigned char identifier[12];
+            uint32_t vkFormat;
+            uint32_t typeSize;
+            uint32_t pixelWidth;
+            uint32_t pixelHeight;
+            uint32_t pixelDepth;
+            uint32_t layerCount;
+            uint32_t faceCount;
+            uint32_t levelCount;
+            uint32_t supercompressionScheme;
+            uint32_t dfdByteOffset;
+            uint32_t dfdByteLength;
+            uint32_t kvdByteOffset;
+            uint32_t kvdByteLength;
+            uint64_t sgdByteOffset;
+            uint64_t sgdByteLength;
+        };
+
+        struct Ktx2LevelIndex {
+
+            uint64_t byteOffset;
+            uint64_t byteLength;
+            uint64_t uncompressedByteLength;
+        };
+
+        bool isSrgb(uint32_t format) {
+
+            return format == KTX2_FORMAT_BC1_RGB_SRGB || format == KTX2_FORMAT_ETC2_RGB8_SRGB;
+        }
+
+        // Basic data format descriptor for a one-sample 4x4 block format
+        std::vector<uint32_t> dataFormatDescriptor(uint32_t format) {
+
+            const uint32_t KHR_DF_MODEL_BC1A = 128;
+            const uint32_t KHR_DF_MODEL_ETC2 = 161;
+            const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+            const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+            const uint32_t KHR_DF_TRANSFER_SRGB = 2;
+            const uint32_t KHR_DF_CHANNEL_COLOR = 0;
+
+            bool bc1 = format == KTX2_FORMAT_BC1_RGB_UNORM || format == KTX2_FORMAT_BC1_RGB_SRGB;
+            uint32_t model = bc1 ? KHR_DF_MODEL_BC1A : KHR_DF_MODEL_ETC2;
+            uint32_t transfer = isSrgb(format) ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR;
+
+            std::vector<uint32_t> dfd;
+            dfd.push_back(4 + 24 + 16);                       // dfdTotalSize
+            dfd.push_back(0);                                 // vendorId, descriptorType
+            dfd.push_back(2 | ((24 + 16) << 16));             // versionNumber, descriptorBlockSize
+            dfd.push_back(model | (KHR_DF_PRIMARIES_BT709 << 8) | (transfer << 16));
+            dfd.push_back(3 | (3 << 8));                      // 4x4x1x1 texel blocks
+            dfd.push_back(Ktx2BlockSize(format));             // bytesPlane0
+            dfd.push_back(0);                                 // bytesPlane4..7
+            dfd.push_back(0 | (63 << 16) | (KHR_DF_CHANNEL_COLOR << 24));
+            dfd.push_back(0);                                 // samplePosition
+            dfd.push_back(0);                                 // sampleLower
+            dfd.push_back(0xFFFFFFFF);                        // sampleUpper
+            return dfd;
+        }
+
+        size_t alignTo(size_t value, size_t alignment) {
+
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    uint32_t Ktx2BlockSize(uint32_t format) {
+
+        switch (format) {
+        case KTX2_FORMAT_BC1_RGB_UNORM:
+        case KTX2_FORMAT_BC1_RGB_SRGB:
+        case KTX2_FORMAT_ETC2_RGB8_UNORM:
+        case KTX2_FORMAT_ETC2_RGB8_SRGB:
+            return 8;
+        default:
+            return 0;
+        }
+    }
+
+    bool ReadKtx2(const std::string& fileName, Ktx2Image& image) {
+
+        std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+        if (!in)
+            return false;
+
+        std::vector<unsigned char> contents((size_t)in.tellg());
+        in.seekg(0);
+        if (!in.read((char*)contents.data(), contents.size()) || contents.size() < sizeof(Ktx2Header))
+            return false;
+
+        Ktx2Header header;
+        memcpy(&header, contents.data(), sizeof(header));
+
+        uint32_t blockSize = Ktx2BlockSize(header.vkFormat);
+        if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 ||
+            blockSize == 0 ||
+            header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 ||
+            header.supercompressionScheme != 0 || header.levelCount == 0)
+            return false;
+
+        size_t indexEnd = sizeof(header) + header.levelCount * sizeof(Ktx2LevelIndex);
+        if (contents.size() < indexEnd)
+            return false;
+
+        image.format = header.vkFormat;
+        image.levels.resize(header.levelCount);
+
+        for (uint32_t level = 0; level < header.levelCount; level++) {
+
+            Ktx2LevelIndex index;
+            memcpy(&index, contents.data() + sizeof(header) + level * sizeof(index), sizeof(index));
+
+            Ktx2Level& current = image.levels[level];
+            current.width = std::max(1u, header.pixelWidth >> level);
+            current.height = std::max(1u, header.pixelHeight >> level);
+
+            size_t expected = (size_t)((current.width + 3) / 4) * ((current.height + 3) / 4) * blockSize;
+            if (index.byteLength != expected || index.byteOffset + index.byteLength > contents.size())
+                return false;
+
+            current.data.assign(contents.begin() + index.byteOffset,
+                contents.begin() + index.byteOffset + index.byteLength);
+        }
+
+        return true;
+    }
+
+    bool WriteKtx2(const std::string& fileName, const Ktx2Image& image) {
+
+        if (image.levels.empty() || Ktx2BlockSize(image.format) == 0)
+            return false;
+
+        std::vector<uint32_t> dfd = dataFormatDescriptor(image.format);
+
+        Ktx2Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+        header.vkFormat = image.format;
+        header.typeSize = 1;
+        header.pixelWidth = image.levels[0].width;
+        header.pixelHeight = image.levels[0].height;
+        header.faceCount = 1;
+        header.levelCount = (uint32_t)image.levels.size();
+        header.dfdByteOffset = (uint32_t)(sizeof(header) + image.levels.size() * sizeof(Ktx2LevelIndex));
+        header.dfdByteLength = (uint32_t)(dfd.size() * sizeof(uint32_t));
+
+        //level data is stored smallest mip first, each aligned to the block size
+        std::vector<Ktx2LevelIndex> levelIndex(image.levels.size());
+        size_t offset = header.dfdByteOffset + header.dfdByteLength;
+        for (size_t level = image.levels.size(); level-- > 0; ) {
+
+            offset = alignTo(offset, 8);
+            levelIndex[level].byteOffset = offset;
+            levelIndex[level].byteLength = image.levels[level].data.size();
+            levelIndex[level].uncompressedByteLength = image.levels[level].data.size();
+            offset += image.levels[level].data.size();
+        }
+
+        std::vector<unsigned char> contents(offset, 0);
+        memcpy(contents.data(), &header, sizeof(header));
+        memcpy(contents.data() + sizeof(header), levelIndex.data(), levelIndex.size() * sizeof(Ktx2LevelIndex));
+        memcpy(contents.data() + header.dfdByteOffset, dfd.data(), header.dfdByteLength);
+        for (size_t level = 0; level < image.levels.size(); level++) {
+
+            memcpy(contents.data() + levelIndex[level].byteOffset,
+                image.levels[level].data.data(), image.levels[level].data.size());
+        }
+
+        std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+        out.write((const char*)contents.data(), contents.size());
+        return (bool)out;
+    }
+}
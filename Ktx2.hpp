@@ -0,0 +1,43 @@
+#ifndef Ktx2_hpp
+#define Ktx2_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Vulkan format ids used by the cooked textures
+    enum Ktx2Format {
+        KTX2_FORMAT_BC1_RGB_UNORM = 131,
+        KTX2_FORMAT_BC1_RGB_SRGB = 132,
+        KTX2_FORMAT_ETC2_RGB8_UNORM = 147,
+        KTX2_FORMAT_ETC2_RGB8_SRGB = 148
+    };
+
+    struct Ktx2Level {
+
+        uint32_t width;
+        uint32_t height;
+        std::vector<unsigned char> data;
+    };
+
+    // Single-face, single-layer 2D texture with a precomputed mip chain.
+    // levels[0] is the base level.
+    struct Ktx2Image {
+
+        uint32_t format;
+        std::vector<Ktx2Level> levels;
+    };
+
+    // Reads the subset of KTX2 written by WriteKtx2: one face, one layer and
+    // no supercompression. No GL calls, safe on any thread.
+    bool ReadKtx2(const std::string& fileName, Ktx2Image& image);
+
+    bool WriteKtx2(const std::string& fileName, const Ktx2Image& image);
+
+    // Bytes of a 4x4 block for the format, 0 if the format is not supported
+    uint32_t Ktx2BlockSize(uint32_t format);
+}
+
+#endif /* Ktx2_hpp */
@@ -0,0 +1,204 @@
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace gps {
+
+    namespace {
+
+        enum { LIGHTS_BUFFER, CLUSTERS_BUFFER, INDICES_BUFFER };
+
+        const GLenum BUFFER_FORMATS[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        const char* const SAMPLER_NAMES[3] = { "pointLights", "clusterLights", "lightIndices" };
+    }
+
+    void LightClusters::Init() {
+
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+
+        for (int i = 0; i < 3; i++) {
+
+            //buffer textures need storage before glTexBuffer
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, BUFFER_FORMATS[i], buffers[i]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        clusterCounts.assign(clusterCount, 0);
+        clusterRanges.assign(2 * clusterCount, 0);
+        Upload(buffers[CLUSTERS_BUFFER], clusterRanges.data(), clusterRanges.size() * sizeof(GLuint));
+    }
+
+    void LightClusters::Release() {
+
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+        for (int i = 0; i < 3; i++)
+            textures[i] = buffers[i] = 0;
+    }
+
+    int LightClusters::DepthSlice(float depth) const {
+
+        //slice boundaries at near * (far / near)^(i / gridZ)
+        if (depth <= nearPlane)
+            return 0;
+        int slice = (int)(std::log(depth / nearPlane) / std::log(farPlane / nearPlane) * gridZ);
+        return std::min(slice, gridZ - 1);
+    }
+
+    bool LightClusters::ClusterBox(const glm::vec3& center, float radius, const glm::mat4& projection, int box[6]) const {
+
+        //view space looks down -z; distances in front of the camera
+        float nearDepth = -center.z - radius;
+        float farDepth = -center.z + radius;
+        if (farDepth <= nearPlane || nearDepth >= farPlane)
+            return false;
+
+        box[4] = DepthSlice(nearDepth);
+        box[5] = DepthSlice(farDepth);
+
+        //a sphere through the near plane can reach any tile
+        if (nearDepth <= nearPlane) {
+
+            box[0] = 0;
+            box[1] = gridX - 1;
+            box[2] = 0;
+            box[3] = gridY - 1;
+            return true;
+        }
+
+        //x / depth is smallest at the nearest depth for negative x and at the farthest for positive x
+        float extents[4];
+        for (int axis = 0; axis < 2; axis++) {
+
+            float scale = projection[axis][axis];
+            float low = center[axis] - radius;
+            float high = center[axis] + radius;
+            extents[2 * axis] = scale * low / (low < 0.0f ? nearDepth : farDepth);
+            extents[2 * axis + 1] = scale * high / (high > 0.0f ? nearDepth : farDepth);
+        }
+
+        if (extents[0] > 1.0f || extents[1] < -1.0f || extents[2] > 1.0f || extents[3] < -1.0f)
+            return false;
+
+        const int tiles[2] = { gridX, gridY };
+        for (int axis = 0; axis < 2; axis++) {
+
+            float low = (extents[2 * axis] * 0.5f + 0.5f) * tiles[axis];
+            float high = (extents[2 * axis + 1] * 0.5f + 0.5f) * tiles[axis];
+            box[2 * axis] = std::max(0, (int)std::floor(low));
+            box[2 * axis + 1] = std::min(tiles[axis] - 1, (int)std::floor(high));
+        }
+        return true;
+    }
+
+    void LightClusters::Update(const std::vector<gps::PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+                               float nearPlane, float farPlane) {
+
+        auto start = std::chrono::steady_clock::now();
+
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+
+        //first pass: the cluster box of every light and how many lights each cluster gets
+        std::fill(clusterCounts.begin(), clusterCounts.end(), 0);
+        lightData.clear();
+        lightBoxes.clear();
+        visibleLights.clear();
+        for (size_t i = 0; i < lights.size(); i++) {
+
+            const gps::PointLight& light = lights[i];
+            glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+
+            int box[6];
+            if (!ClusterBox(center, light.radius, projection, box))
+                continue;
+
+            for (int z = box[4]; z <= box[5]; z++)
+                for (int y = box[2]; y <= box[3]; y++)
+                    for (int x = box[0]; x <= box[1]; x++)
+                        clusterCounts[(z * gridY + y) * gridX + x]++;
+
+            //shaded in view space, like the rest of shaderStart.frag
+            lightData.push_back(glm::vec4(center, light.radius));
+            lightData.push_back(glm::vec4(light.color, 0.0f));
+            lightBoxes.insert(lightBoxes.end(), box, box + 6);
+            visibleLights.push_back((GLuint)i);
+        }
+
+        //prefix sum into (first index, count) pairs
+        GLuint total = 0;
+        stats.maxClusterLights = 0;
+        for (int cluster = 0; cluster < clusterCount; cluster++) {
+
+            clusterRanges[2 * cluster] = total;
+            clusterRanges[2 * cluster + 1] = 0;
+            total += clusterCounts[cluster];
+            stats.maxClusterLights = std::max(stats.maxClusterLights, (unsigned)clusterCounts[cluster]);
+        }
+
+        //second pass: index lists, in light order within each cluster
+        lightIndices.resize(total);
+        for (size_t light = 0; light < visibleLights.size(); light++) {
+
+            const int* box = &lightBoxes[6 * light];
+            for (int z = box[4]; z <= box[5]; z++)
+                for (int y = box[2]; y <= box[3]; y++)
+                    for (int x = box[0]; x <= box[1]; x++) {
+
+                        int cluster = (z * gridY + y) * gridX + x;
+                        lightIndices[clusterRanges[2 * cluster] + clusterRanges[2 * cluster + 1]++] = (GLuint)light;
+                    }
+        }
+
+        Upload(buffers[LIGHTS_BUFFER], lightData.data(), lightData.size() * sizeof(glm::vec4));
+        Upload(buffers[CLUSTERS_BUFFER], clusterRanges.data(), clusterRanges.size() * sizeof(GLuint));
+        Upload(buffers[INDICES_BUFFER], lightIndices.data(), lightIndices.size() * sizeof(GLuint));
+
+        stats.lights = (unsigned)lights.size();
+        stats.visibleLights = (unsigned)visibleLights.size();
+        stats.lightIndices = total;
+        stats.binTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void LightClusters::Upload(GLuint buffer, const void* data, size_t bytes) {
+
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        //orphan - the previous frame may still be shading with the old lists
+        glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, sizeof(glm::vec4)), NULL, GL_STREAM_DRAW);
+        if (bytes > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void LightClusters::Bind(gps::Shader& shader, int viewportWidth, int viewportHeight) const {
+
+        shader.useShaderProgram();
+
+        const int units[3] = { lightsUnit, clustersUnit, indicesUnit };
+        for (int i = 0; i < 3; i++) {
+
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glUniform1i(shader.getUniformLocation(SAMPLER_NAMES[i]), units[i]);
+        }
+
+        //slice = log(depth) * scale + bias, the same spacing as DepthSlice
+        float depthScale = gridZ / std::log(farPlane / nearPlane);
+        glUniform3i(shader.getUniformLocation("clusterGrid"), gridX, gridY, gridZ);
+        glUniform2f(shader.getUniformLocation("clusterTileSize"), (float)viewportWidth / gridX, (float)viewportHeight / gridY);
+        glUniform2f(shader.getUniformLocation("clusterDepthSlicing"), depthScale, -std::log(nearPlane) * depthScale);
+    }
+
+    const gps::LightClusterStats& LightClusters::GetStats() const {
+
+        return stats;
+    }
+}
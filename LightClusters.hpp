@@ -0,0 +1,107 @@
+#ifndef LightClusters_hpp
+#define LightClusters_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Small unshadowed light, such as a runway edge or apron light
+    struct PointLight {
+
+        glm::vec3 position;
+        // no light reaches past it
+        float radius;
+        glm::vec3 color;
+    };
+
+    // Per-frame binning counters
+    struct LightClusterStats {
+
+        unsigned lights;
+        // lights overlapping at least one cluster of the view
+        unsigned visibleLights;
+        // light references over all clusters
+        unsigned lightIndices;
+        unsigned maxClusterLights;
+        double binTime;
+    };
+
+    // Clustered forward lighting. The view frustum is split into a grid of
+    // clusters - screen tiles times depth slices spaced exponentially
+    // between the near and far planes - and every frame the lights are
+    // binned on the CPU into the clusters their spheres overlap. The lit
+    // fragment shader finds its cluster from gl_FragCoord and its view depth
+    // and loops over that cluster's lights only.
+    //
+    // GL 4.1 has no storage buffers, so the lights (view-space position and
+    // radius, colour), the (first index, count) pair of every cluster and
+    // the light index lists are read from buffer textures.
+    class LightClusters {
+
+    public:
+        static const int gridX = 16;
+        static const int gridY = 9;
+        static const int gridZ = 24;
+        static const int clusterCount = gridX * gridY * gridZ;
+
+        // texture units of the light, cluster and index buffer textures
+        static const int lightsUnit = 4;
+        static const int clustersUnit = 5;
+        static const int indicesUnit = 6;
+
+        // Creates the buffers and their buffer textures
+        void Init();
+
+        void Release();
+
+        // Bins the lights into the clusters of the view and uploads the result
+        void Update(const std::vector<gps::PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+                    float nearPlane, float farPlane);
+
+        // Binds the buffer textures and sets the grid uniforms of a lit program
+        void Bind(gps::Shader& shader, int viewportWidth, int viewportHeight) const;
+
+        const gps::LightClusterStats& GetStats() const;
+
+    private:
+        GLuint buffers[3] = {};
+        GLuint textures[3] = {};
+
+        float nearPlane = 0.1f;
+        float farPlane = 1000.0f;
+
+        // binning scratch and upload data, reused between frames
+        std::vector<GLuint> clusterCounts;
+        std::vector<GLuint> clusterRanges;
+        std::vector<GLuint> lightIndices;
+        std::vector<glm::vec4> lightData;
+        // cluster box of every visible light: min x, max x, min y, max y, min z, max z
+        std::vector<int> lightBoxes;
+        std::vector<GLuint> visibleLights;
+
+        gps::LightClusterStats stats = {};
+
+        // Depth slice holding a positive view depth
+        int DepthSlice(float depth) const;
+
+        // Cluster box of a view-space sphere; false when it misses the view
+        bool ClusterBox(const glm::vec3& center, float radius, const glm::mat4& projection, int box[6]) const;
+
+        // Replaces the contents of one buffer, orphaning the old storage
+        static void Upload(GLuint buffer, const void* data, size_t bytes);
+    };
+}
+
+#endif /* LightClusters_hpp */
@@ -1,6 +1,43 @@
 #include "Mesh.hpp"
+#include "GeometryArena.hpp"
+#include "InstanceBuffer.hpp"
+#include "RenderQueue.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
 namespace gps {
 
+	namespace {
+
+		// Bytes of one position - 8 packed, 12 as floats
+		struct PositionKey {
+
+			GLuint words[3];
+
+			bool operator==(const PositionKey& other) const {
+				return memcmp(words, other.words, sizeof(words)) == 0;
+			}
+		};
+
+		struct PositionKeyHash {
+
+			size_t operator()(const PositionKey& key) const {
+				size_t hash = 2166136261u;
+				for (int i = 0; i < 3; i++)
+					hash = (hash ^ key.words[i]) * 16777619u;
+				return hash;
+			}
+		};
+	}
+
+	bool Mesh::packedVertices = false;
+	bool Mesh::depthStreams = true;
+
 	/* Mesh Constructor */
 	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) {
 
@@ -15,47 +52,217 @@ namespace gps {
 	    return this->buffers;
 	}
 
+	Buffers Mesh::getDepthBuffers() {
+	    return this->depthBuffers;
+	}
+
+	const BoundingVolume& Mesh::getBoundingVolume() const {
+	    return this->boundingVolume;
+	}
+
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)	{
+	void Mesh::Draw(gps::Shader& shader)	{
 
 		shader.useShaderProgram();
 
-		//set textures
+		//position dequantization
+		glUniform3fv(shader.getUniformLocation("meshBoundsMin"), 1, &this->boundsMin[0]);
+		glUniform3fv(shader.getUniformLocation("meshBoundsExtent"), 1, &this->boundsExtent[0]);
+
+		//set textures - each type has its own unit
 		for (GLuint i = 0; i < textures.size(); i++) {
 
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
+			GLint unit = gps::RenderQueue::TextureUnit(this->textures[i].type);
+			if (unit < 0)
+				continue;
+
+			glActiveTexture(GL_TEXTURE0 + unit);
+			glUniform1i(shader.getUniformLocation(this->textures[i].type.c_str()), unit);
 			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
 
 		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
+		glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT,
+			(GLvoid*)(this->firstIndex * sizeof(GLuint)), this->baseVertex);
 		glBindVertexArray(0);
 
         for(GLuint i = 0; i < this->textures.size(); i++) {
 
-            glActiveTexture(GL_TEXTURE0 + i);
+            GLint unit = gps::RenderQueue::TextureUnit(this->textures[i].type);
+            if (unit < 0)
+                continue;
+
+            glActiveTexture(GL_TEXTURE0 + unit);
             glBindTexture(GL_TEXTURE_2D, 0);
         }
 
     }
 
+	uint32_t Mesh::getMaterialTextures(GLuint* unitTextures) const {
+
+		//missing types sample texture 0, as after Draw unbinds
+		uint32_t materialFeatures = 0;
+		for (int unit = 0; unit < gps::RenderQueue::textureUnits; unit++)
+			unitTextures[unit] = 0;
+		for (size_t i = 0; i < this->textures.size(); i++) {
+
+			GLint unit = gps::RenderQueue::TextureUnit(this->textures[i].type);
+			if (unit >= 0)
+				unitTextures[unit] = this->textures[i].id;
+			if (this->textures[i].type == "specularTexture")
+				materialFeatures |= gps::SHADER_HAS_SPECULAR_MAP;
+		}
+		return materialFeatures;
+	}
+
+	void Mesh::Submit(gps::RenderQueue& queue, gps::Shader& shader, const glm::mat4& model) {
+
+		GLuint unitTextures[gps::RenderQueue::textureUnits];
+		uint32_t materialFeatures = getMaterialTextures(unitTextures);
+
+		queue.Submit(shader.getVariant(materialFeatures), this->buffers.VAO, (GLsizei)this->indices.size(), this->firstIndex, this->baseVertex,
+			unitTextures, model, this->boundsMin, this->boundsExtent);
+	}
+
+	void Mesh::SubmitInstanced(gps::RenderQueue& queue, gps::Shader& shader, const gps::InstanceBuffer& instances) {
+
+		if (instances.GetCount() == 0)
+			return;
+
+		//arena meshes share one VAO per instance buffer
+		GLuint vao = this->buffers.VAO;
+		if (this->inArena) {
+			vao = gps::GeometryArena::Instance().GetInstancedVAO(instances);
+		}
+		else if (this->instanceBuffer != instances.GetBuffer()) {
+
+			glBindVertexArray(this->buffers.VAO);
+			instances.BindAttributes();
+			glBindVertexArray(0);
+			this->instanceBuffer = instances.GetBuffer();
+		}
+
+		GLuint unitTextures[gps::RenderQueue::textureUnits];
+		uint32_t materialFeatures = getMaterialTextures(unitTextures);
+
+		queue.Submit(shader.getVariant(materialFeatures), vao, (GLsizei)this->indices.size(), this->firstIndex, this->baseVertex,
+			unitTextures, glm::mat4(1.0f), this->boundsMin, this->boundsExtent, instances.GetCount());
+	}
+
+	void Mesh::SubmitDepth(gps::RenderQueue& queue, gps::Shader& shader, const glm::mat4& model) {
+
+		if (!this->hasDepthStream || !depthStreams) {
+			this->Submit(queue, shader, model);
+			return;
+		}
+
+		//depth programs sample nothing, every unit is left as it is
+		GLuint unitTextures[gps::RenderQueue::textureUnits] = { 0, 0, 0 };
+		queue.Submit(shader, this->depthBuffers.VAO, (GLsizei)this->indices.size(), this->depthFirstIndex, this->depthBaseVertex,
+			unitTextures, model, this->boundsMin, this->boundsExtent);
+	}
+
+	void Mesh::SubmitDepthInstanced(gps::RenderQueue& queue, gps::Shader& shader, const gps::InstanceBuffer& instances) {
+
+		if (!this->hasDepthStream || !depthStreams) {
+			this->SubmitInstanced(queue, shader, instances);
+			return;
+		}
+
+		if (instances.GetCount() == 0)
+			return;
+
+		GLuint vao = this->depthBuffers.VAO;
+		if (this->inArena) {
+			vao = gps::GeometryArena::DepthInstance().GetInstancedVAO(instances);
+		}
+		else if (this->depthInstanceBuffer != instances.GetBuffer()) {
+
+			glBindVertexArray(this->depthBuffers.VAO);
+			instances.BindAttributes();
+			glBindVertexArray(0);
+			this->depthInstanceBuffer = instances.GetBuffer();
+		}
+
+		GLuint unitTextures[gps::RenderQueue::textureUnits] = { 0, 0, 0 };
+		queue.Submit(shader, vao, (GLsizei)this->indices.size(), this->depthFirstIndex, this->depthBaseVertex,
+			unitTextures, glm::mat4(1.0f), this->boundsMin, this->boundsExtent, instances.GetCount());
+	}
+
 	// Initializes all the buffer objects/arrays
 	void Mesh::setupMesh() {
 
+		this->packed = packedVertices;
+		this->instanceBuffer = 0;
+		this->boundsMin = glm::vec3(0.0f);
+		this->boundsExtent = glm::vec3(1.0f);
+
+		this->computeBoundingVolume();
+
+		std::vector<PackedVertex> packedData;
+		if (this->packed) {
+
+			this->boundsMin = this->boundingVolume.aabbMin;
+			this->boundsExtent = this->boundingVolume.aabbMax - this->boundingVolume.aabbMin;
+
+			packedData = packVertices();
+		}
+
+		this->setupDepthStream(packedData);
+
+		// Suballocate from the shared buffers - the arena owns the VAO
+		if (gps::GeometryArena::enabled) {
+
+			const void* vertexData = this->packed ? (const void*)packedData.data() : (const void*)this->vertices.data();
+			gps::ArenaRange range = gps::GeometryArena::Instance().Allocate(vertexData, this->vertices.size(), this->packed,
+				this->indices.data(), this->indices.size());
+
+			this->inArena = true;
+			this->baseVertex = range.baseVertex;
+			this->firstIndex = range.firstIndex;
+			this->buffers.VAO = gps::GeometryArena::Instance().GetVAO();
+			this->buffers.VBO = 0;
+			this->buffers.EBO = 0;
+			return;
+		}
+
+		this->inArena = false;
+		this->baseVertex = 0;
+		this->firstIndex = 0;
+
 		// Create buffers/arrays
 		glGenVertexArrays(1, &this->buffers.VAO);
 		glGenBuffers(1, &this->buffers.VBO);
 		glGenBuffers(1, &this->buffers.EBO);
 
 		glBindVertexArray(this->buffers.VAO);
-		// Load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
 
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
+
+		if (this->packed) {
+
+			glBufferData(GL_ARRAY_BUFFER, packedData.size() * sizeof(PackedVertex), packedData.data(), GL_STATIC_DRAW);
+
+			// Positions - unorm within the bounds
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Position));
+			// Normals - w is unused
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+			// Texture Coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+
+			glBindVertexArray(0);
+			return;
+		}
+
+		// Load data into vertex buffers
+		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+
 		// Set the vertex attribute pointers
 		// Vertex Positions
 		glEnableVertexAttribArray(0);
@@ -69,4 +276,127 @@ namespace gps {
 
 		glBindVertexArray(0);
 	}
+
+	// Position-only copy of the mesh for the depth passes. Vertices that only
+	// differ in normal or texture coordinates collapse into one, so the depth
+	// pass fetches fewer and smaller vertices than the interleaved buffer
+	void Mesh::setupDepthStream(const std::vector<PackedVertex>& packedData) {
+
+		this->hasDepthStream = depthStreams && !this->vertices.empty();
+		this->depthBuffers.VAO = 0;
+		this->depthBuffers.VBO = 0;
+		this->depthBuffers.EBO = 0;
+		this->depthBaseVertex = 0;
+		this->depthFirstIndex = 0;
+		this->depthInstanceBuffer = 0;
+		if (!this->hasDepthStream)
+			return;
+
+		//same position format as the full vertices, without the rest
+		size_t stride = this->packed ? sizeof(PackedVertex::Position) : sizeof(Vertex::Position);
+
+		std::vector<unsigned char> positions;
+		std::vector<GLuint> remap(this->vertices.size());
+		std::unordered_map<PositionKey, GLuint, PositionKeyHash> uniquePositions;
+		for (size_t i = 0; i < this->vertices.size(); i++) {
+
+			const unsigned char* position = this->packed ?
+				(const unsigned char*)packedData[i].Position : (const unsigned char*)&this->vertices[i].Position;
+
+			PositionKey key = {};
+			memcpy(key.words, position, stride);
+
+			auto inserted = uniquePositions.emplace(key, (GLuint)uniquePositions.size());
+			if (inserted.second)
+				positions.insert(positions.end(), position, position + stride);
+			remap[i] = inserted.first->second;
+		}
+
+		std::vector<GLuint> depthIndices(this->indices.size());
+		for (size_t i = 0; i < this->indices.size(); i++)
+			depthIndices[i] = remap[this->indices[i]];
+
+		size_t positionCount = uniquePositions.size();
+
+		if (gps::GeometryArena::enabled) {
+
+			gps::ArenaRange range = gps::GeometryArena::DepthInstance().Allocate(positions.data(), positionCount, this->packed,
+				depthIndices.data(), depthIndices.size());
+
+			this->depthBaseVertex = range.baseVertex;
+			this->depthFirstIndex = range.firstIndex;
+			this->depthBuffers.VAO = gps::GeometryArena::DepthInstance().GetVAO();
+			return;
+		}
+
+		glGenVertexArrays(1, &this->depthBuffers.VAO);
+		glGenBuffers(1, &this->depthBuffers.VBO);
+		glGenBuffers(1, &this->depthBuffers.EBO);
+
+		glBindVertexArray(this->depthBuffers.VAO);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->depthBuffers.EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, depthIndices.size() * sizeof(GLuint), depthIndices.data(), GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ARRAY_BUFFER, this->depthBuffers.VBO);
+		glBufferData(GL_ARRAY_BUFFER, positions.size(), positions.data(), GL_STATIC_DRAW);
+
+		glEnableVertexAttribArray(0);
+		if (this->packed)
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, (GLsizei)stride, (GLvoid*)0);
+		else
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (GLsizei)stride, (GLvoid*)0);
+
+		glBindVertexArray(0);
+	}
+
+	void Mesh::computeBoundingVolume() {
+
+		BoundingVolume& volume = this->boundingVolume;
+		volume.aabbMin = this->vertices.empty() ? glm::vec3(0.0f) : this->vertices[0].Position;
+		volume.aabbMax = volume.aabbMin;
+		for (size_t i = 0; i < this->vertices.size(); i++) {
+
+			volume.aabbMin = glm::min(volume.aabbMin, this->vertices[i].Position);
+			volume.aabbMax = glm::max(volume.aabbMax, this->vertices[i].Position);
+		}
+
+		//tighter than half the diagonal for most shapes
+		volume.sphereCenter = (volume.aabbMin + volume.aabbMax) * 0.5f;
+		float radiusSquared = 0.0f;
+		for (size_t i = 0; i < this->vertices.size(); i++) {
+
+			glm::vec3 offset = this->vertices[i].Position - volume.sphereCenter;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		volume.sphereRadius = std::sqrt(radiusSquared);
+	}
+
+	// Quantizes the vertices against the mesh bounds
+	std::vector<PackedVertex> Mesh::packVertices() const {
+
+		glm::vec3 scale;
+		for (int c = 0; c < 3; c++)
+			scale[c] = this->boundsExtent[c] > 0.0f ? 1.0f / this->boundsExtent[c] : 0.0f;
+
+		std::vector<PackedVertex> packedData(this->vertices.size());
+		for (size_t i = 0; i < this->vertices.size(); i++) {
+
+			const Vertex& vertex = this->vertices[i];
+			PackedVertex& packedVertex = packedData[i];
+
+			glm::vec3 position = (vertex.Position - this->boundsMin) * scale;
+			packedVertex.Position[0] = glm::packUnorm1x16(position.x);
+			packedVertex.Position[1] = glm::packUnorm1x16(position.y);
+			packedVertex.Position[2] = glm::packUnorm1x16(position.z);
+			packedVertex.Position[3] = 0;
+
+			packedVertex.Normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.Normal, 0.0f));
+
+			packedVertex.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+			packedVertex.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+		}
+
+		return packedData;
+	}
 }
@@ -19,6 +19,9 @@
 
 namespace gps {
 
+    class RenderQueue;
+    class InstanceBuffer;
+
     struct Vertex {
 
         glm::vec3 Position;
@@ -26,6 +29,16 @@ namespace gps {
         glm::vec2 TexCoords;
     };
 
+    // Compact 16 byte layout used when Mesh::packedVertices is set: positions
+    // are 16-bit unorm relative to the mesh bounds, normals 10_10_10_2 snorm
+    // and texture coordinates half floats
+    struct PackedVertex {
+
+        GLushort Position[4];
+        GLuint Normal;
+        GLushort TexCoords[2];
+    };
+
     struct Texture {
 
         GLuint id;
@@ -41,6 +54,27 @@ namespace gps {
         glm::vec3 specular;
     };
 
+    // CPU-side mesh data produced by the loaders, before it is uploaded
+    struct MeshData {
+
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        // texture references only - ids are assigned at upload time
+        std::vector<Texture> textures;
+        Material material;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+
+    // Object-space bounds of a mesh, computed when it is created
+    struct BoundingVolume {
+
+        glm::vec3 aabbMin;
+        glm::vec3 aabbMax;
+        glm::vec3 sphereCenter;
+        float sphereRadius;
+    };
+
     struct Buffers {
         GLuint VAO;
         GLuint VBO;
@@ -50,23 +84,79 @@ namespace gps {
     class Mesh {
 
     public:
+        // Upload new meshes as PackedVertex; shaders rebuild positions from the
+        // meshBoundsMin/meshBoundsExtent uniforms set by Draw
+        static bool packedVertices;
+
+        // Give new meshes a position-only copy for the depth passes; cleared at
+        // runtime, SubmitDepth falls back to the full vertices
+        static bool depthStreams;
+
         std::vector<Vertex> vertices;
         std::vector<GLuint> indices;
         std::vector<Texture> textures;
 
 	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
+	    // VBO and EBO are 0 for meshes living in the GeometryArena
 	    Buffers getBuffers();
 
-	    void Draw(gps::Shader shader);
+	    // Buffers of the position-only stream - all 0 without one, VBO and EBO
+	    // are 0 in the GeometryArena
+	    Buffers getDepthBuffers();
+
+	    const BoundingVolume& getBoundingVolume() const;
+
+	    void Draw(gps::Shader& shader);
+
+	    // Queues the mesh for a sorted draw with the given transform, with the
+	    // variant of a permutation shader that matches its textures
+	    void Submit(gps::RenderQueue& queue, gps::Shader& shader, const glm::mat4& model);
+
+	    // Queues one instanced draw of the mesh for every entry of instances
+	    void SubmitInstanced(gps::RenderQueue& queue, gps::Shader& shader, const gps::InstanceBuffer& instances);
+
+	    // As Submit and SubmitInstanced, drawn from the position-only stream.
+	    // Only for programs that read nothing but vPosition and no textures
+	    void SubmitDepth(gps::RenderQueue& queue, gps::Shader& shader, const glm::mat4& model);
+	    void SubmitDepthInstanced(gps::RenderQueue& queue, gps::Shader& shader, const gps::InstanceBuffer& instances);
 
     private:
         /*  Render data  */
         Buffers buffers;
+        BoundingVolume boundingVolume;
+        // dequantization range - (0, 1) for float vertices
+        glm::vec3 boundsMin;
+        glm::vec3 boundsExtent;
+        bool packed;
+        // instance buffer the VAO's instance attributes point at
+        GLuint instanceBuffer;
+        // location in the shared GeometryArena buffers - 0 for own buffers
+        GLint baseVertex;
+        GLuint firstIndex;
+        bool inArena;
+        // position-only stream: own index buffer over the deduplicated positions
+        Buffers depthBuffers;
+        GLint depthBaseVertex;
+        GLuint depthFirstIndex;
+        GLuint depthInstanceBuffer;
+        bool hasDepthStream;
 
 	    // Initializes all the buffer objects/arrays
 	    void setupMesh();
 
+	    // Builds and uploads the position-only stream
+	    void setupDepthStream(const std::vector<PackedVertex>& packedData);
+
+	    std::vector<PackedVertex> packVertices() const;
+
+	    // Fills the texture of every RenderQueue unit and returns the
+	    // ShaderFeature bits the textures allow
+	    uint32_t getMaterialTextures(GLuint* unitTextures) const;
+
+	    // AABB of the vertices and a sphere around its centre
+	    void computeBoundingVolume();
+
     };
 
 }
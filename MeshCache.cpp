@@ -0,0 +1,261 @@
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+    namespace {
+
+        const char CACHE_MAGIC[8] = { 'G', 'P', 'S', 'M', 'E', 'S', 'H', '\0' };
+        const uint32_t CACHE_VERSION = 3;
+
+        struct CacheHeader {
+
+            char magic[8];
+            uint32_t version;
+            uint32_t meshCount;
+            uint64_t sourceSize;
+            int64_t sourceTime;
+            uint32_t optimized;
+            // followed by the path, size and time of every mtllib file
+            uint32_t materialLibraryCount;
+        };
+
+        struct MeshHeader {
+
+            uint32_t vertexCount;
+            uint32_t indexCount;
+            uint32_t textureCount;
+            float material[9];
+            float bounds[6];
+        };
+
+        bool sourceStamp(const std::string& fileName, uint64_t& size, int64_t& time) {
+
+            std::error_code ec;
+            size = std::filesystem::file_size(fileName, ec);
+            if (ec)
+                return false;
+            time = (int64_t)std::filesystem::last_write_time(fileName, ec).time_since_epoch().count();
+            return !ec;
+        }
+
+        // .mtl files named by the mtllib lines of an .obj, relative to its directory
+        std::vector<std::string> materialLibraries(const std::string& objFileName) {
+
+            std::string basePath = objFileName.substr(0, objFileName.find_last_of('/') + 1);
+            std::vector<std::string> libraries;
+            std::ifstream obj(objFileName);
+            std::string line;
+            while (std::getline(obj, line)) {
+
+                if (line.compare(0, 7, "mtllib ") != 0 && line.compare(0, 7, "mtllib\t") != 0)
+                    continue;
+
+                std::istringstream names(line.substr(7));
+                std::string name;
+                while (names >> name)
+                    libraries.push_back(basePath + name);
+            }
+            return libraries;
+        }
+
+        // A missing .mtl stamps as 0, so creating it later also invalidates the cache
+        void materialStamp(const std::string& fileName, uint64_t& size, int64_t& time) {
+
+            if (!sourceStamp(fileName, size, time))
+                size = 0, time = 0;
+        }
+
+        // Bounds-checked cursor over the cache file contents
+        struct Reader {
+
+            const char* data;
+            size_t size;
+            size_t offset;
+
+            bool read(void* dst, size_t bytes) {
+
+                if (size - offset < bytes)
+                    return false;
+                memcpy(dst, data + offset, bytes);
+                offset += bytes;
+                return true;
+            }
+
+            bool readString(std::string& str) {
+
+                uint32_t length;
+                if (!read(&length, sizeof(length)) || size - offset < length)
+                    return false;
+                str.assign(data + offset, length);
+                offset += length;
+                return true;
+            }
+        };
+
+        void writeString(std::ofstream& out, const std::string& str) {
+
+            uint32_t length = (uint32_t)str.size();
+            out.write((const char*)&length, sizeof(length));
+            out.write(str.data(), length);
+        }
+    }
+
+    bool MeshCache::enabled = true;
+
+    std::string MeshCache::CachePath(const std::string& objFileName) {
+
+        return objFileName + ".meshbin";
+    }
+
+    bool MeshCache::Read(const std::string& objFileName, std::vector<gps::MeshData>& meshes) {
+
+        if (!enabled)
+            return false;
+
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        if (!sourceStamp(objFileName, sourceSize, sourceTime))
+            return false;
+
+        //load the whole cache with a single read
+        std::ifstream in(CachePath(objFileName), std::ios::binary | std::ios::ate);
+        if (!in)
+            return false;
+
+        std::vector<char> contents((size_t)in.tellg());
+        in.seekg(0);
+        if (!in.read(contents.data(), contents.size()))
+            return false;
+
+        Reader reader = { contents.data(), contents.size(), 0 };
+
+        CacheHeader header;
+        if (!reader.read(&header, sizeof(header)) ||
+            memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+            header.version != CACHE_VERSION ||
+            header.sourceSize != sourceSize ||
+            header.sourceTime != sourceTime ||
+            header.optimized != (uint32_t)gps::MeshOptimizer::enabled) {
+
+            std::cout << "Mesh cache for " << objFileName << " is stale" << std::endl;
+            return false;
+        }
+
+        //materials come from the .mtl files, which change independently of the .obj
+        for (uint32_t i = 0; i < header.materialLibraryCount; i++) {
+
+            std::string library;
+            uint64_t librarySize, cachedSize;
+            int64_t libraryTime, cachedTime;
+            if (!reader.readString(library) || !reader.read(&cachedSize, sizeof(cachedSize)) ||
+                !reader.read(&cachedTime, sizeof(cachedTime)))
+                return false;
+
+            materialStamp(library, librarySize, libraryTime);
+            if (librarySize != cachedSize || libraryTime != cachedTime) {
+
+                std::cout << "Mesh cache for " << objFileName << " is stale (" << library << " changed)" << std::endl;
+                return false;
+            }
+        }
+
+        std::vector<gps::MeshData> result(header.meshCount);
+        for (gps::MeshData& mesh : result) {
+
+            MeshHeader meshHeader;
+            if (!reader.read(&meshHeader, sizeof(meshHeader)))
+                return false;
+
+            mesh.material.ambient = glm::vec3(meshHeader.material[0], meshHeader.material[1], meshHeader.material[2]);
+            mesh.material.diffuse = glm::vec3(meshHeader.material[3], meshHeader.material[4], meshHeader.material[5]);
+            mesh.material.specular = glm::vec3(meshHeader.material[6], meshHeader.material[7], meshHeader.material[8]);
+            mesh.boundsMin = glm::vec3(meshHeader.bounds[0], meshHeader.bounds[1], meshHeader.bounds[2]);
+            mesh.boundsMax = glm::vec3(meshHeader.bounds[3], meshHeader.bounds[4], meshHeader.bounds[5]);
+
+            mesh.vertices.resize(meshHeader.vertexCount);
+            mesh.indices.resize(meshHeader.indexCount);
+            if (!reader.read(mesh.vertices.data(), mesh.vertices.size() * sizeof(gps::Vertex)) ||
+                !reader.read(mesh.indices.data(), mesh.indices.size() * sizeof(GLuint)))
+                return false;
+
+            mesh.textures.resize(meshHeader.textureCount);
+            for (gps::Texture& texture : mesh.textures) {
+
+                texture.id = 0;
+                if (!reader.readString(texture.type) || !reader.readString(texture.path))
+                    return false;
+            }
+        }
+
+        meshes = std::move(result);
+        return true;
+    }
+
+    bool MeshCache::Write(const std::string& objFileName, const std::vector<gps::MeshData>& meshes) {
+
+        if (!enabled)
+            return false;
+
+        CacheHeader header;
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = CACHE_VERSION;
+        header.meshCount = (uint32_t)meshes.size();
+        header.optimized = (uint32_t)gps::MeshOptimizer::enabled;
+        if (!sourceStamp(objFileName, header.sourceSize, header.sourceTime))
+            return false;
+
+        std::vector<std::string> libraries = materialLibraries(objFileName);
+        header.materialLibraryCount = (uint32_t)libraries.size();
+
+        std::ofstream out(CachePath(objFileName), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "WARNING: could not write mesh cache for " << objFileName << std::endl;
+            return false;
+        }
+
+        out.write((const char*)&header, sizeof(header));
+
+        for (const std::string& library : libraries) {
+
+            uint64_t librarySize;
+            int64_t libraryTime;
+            materialStamp(library, librarySize, libraryTime);
+            writeString(out, library);
+            out.write((const char*)&librarySize, sizeof(librarySize));
+            out.write((const char*)&libraryTime, sizeof(libraryTime));
+        }
+
+        for (const gps::MeshData& mesh : meshes) {
+
+            MeshHeader meshHeader = {
+                (uint32_t)mesh.vertices.size(),
+                (uint32_t)mesh.indices.size(),
+                (uint32_t)mesh.textures.size(),
+                { mesh.material.ambient.x, mesh.material.ambient.y, mesh.material.ambient.z,
+                  mesh.material.diffuse.x, mesh.material.diffuse.y, mesh.material.diffuse.z,
+                  mesh.material.specular.x, mesh.material.specular.y, mesh.material.specular.z },
+                { mesh.boundsMin.x, mesh.boundsMin.y, mesh.boundsMin.z,
+                  mesh.boundsMax.x, mesh.boundsMax.y, mesh.boundsMax.z }
+            };
+            out.write((const char*)&meshHeader, sizeof(meshHeader));
+            out.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(gps::Vertex));
+            out.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+
+            for (const gps::Texture& texture : mesh.textures) {
+
+                writeString(out, texture.type);
+                writeString(out, texture.path);
+            }
+        }
+
+        return (bool)out;
+    }
+}
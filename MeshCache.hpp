@@ -0,0 +1,30 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Binary precompiled mesh cache stored next to each .obj file.
+    // The cache is only valid while the size and modification time of the
+    // source .obj and of every .mtl it references match the values recorded
+    // in the cache and it was built with the current MeshOptimizer setting.
+    class MeshCache {
+
+    public:
+        // Set to false to always parse the text .obj (cold load)
+        static bool enabled;
+
+        static std::string CachePath(const std::string& objFileName);
+
+        // Fills meshes from the cache; returns false if it is missing or stale
+        static bool Read(const std::string& objFileName, std::vector<gps::MeshData>& meshes);
+
+        static bool Write(const std::string& objFileName, const std::vector<gps::MeshData>& meshes);
+    };
+}
+
+#endif /* MeshCache_hpp */
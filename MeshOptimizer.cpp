@@ -0,0 +1,342 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    bool MeshOptimizer::enabled = true;
+
+    namespace {
+
+        //LRU size the triangle ordering optimises for
+        const int kCacheSize = 32;
+        const int kMaxValence = 32;
+
+        const float kLastTriangleScore = 0.75f;
+        const float kCacheDecayPower = 1.5f;
+        const float kValenceBoostScale = 2.0f;
+        const float kValenceBoostPower = 0.5f;
+
+        struct ScoreTables {
+
+            float cache[kCacheSize];
+            float valence[kMaxValence];
+
+            ScoreTables() {
+
+                //the three most recent vertices score the same so fans and strips are not preferred
+                for (int i = 0; i < kCacheSize; i++)
+                    cache[i] = i < 3 ? kLastTriangleScore
+                        : powf(1.0f - (float)(i - 3) / (float)(kCacheSize - 3), kCacheDecayPower);
+
+                //vertices with few triangles left are finished first so they leave no stragglers
+                valence[0] = 0.0f;
+                for (int i = 1; i < kMaxValence; i++)
+                    valence[i] = kValenceBoostScale * powf((float)i, -kValenceBoostPower);
+            }
+        };
+
+        float vertexScore(const ScoreTables& tables, int cachePosition, unsigned liveTriangles) {
+
+            if (liveTriangles == 0)
+                return -1.0f;
+
+            float score = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+            score += liveTriangles < (unsigned)kMaxValence ? tables.valence[liveTriangles]
+                : kValenceBoostScale * powf((float)liveTriangles, -kValenceBoostPower);
+            return score;
+        }
+
+        //FIFO cache simulation; returns how many of the triangle's vertices missed
+        unsigned simulateTriangle(const GLuint* triangle, std::vector<unsigned>& cacheTime,
+                                  unsigned& timestamp, unsigned cacheSize) {
+
+            unsigned misses = 0;
+            for (int k = 0; k < 3; k++) {
+
+                if (timestamp - cacheTime[triangle[k]] > cacheSize) {
+
+                    cacheTime[triangle[k]] = timestamp++;
+                    misses++;
+                }
+            }
+            return misses;
+        }
+    }
+
+    VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount,
+                                                       unsigned cacheSize) {
+
+        VertexCacheStats stats = { 0.0f, 0.0f };
+        if (indices.size() < 3)
+            return stats;
+
+        std::vector<unsigned> cacheTime(vertexCount, 0);
+        unsigned timestamp = cacheSize + 1;
+        size_t misses = 0;
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+            misses += simulateTriangle(&indices[i], cacheTime, timestamp, cacheSize);
+
+        size_t uniqueVertices = 0;
+        for (size_t v = 0; v < vertexCount; v++)
+            if (cacheTime[v] != 0)
+                uniqueVertices++;
+
+        stats.acmr = (float)misses / (float)(indices.size() / 3);
+        stats.atvr = uniqueVertices ? (float)misses / (float)uniqueVertices : 0.0f;
+        return stats;
+    }
+
+    void MeshOptimizer::OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount) {
+
+        static const ScoreTables tables;
+
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        //triangles using each vertex, packed per vertex; the first liveTriangles[v] are not emitted yet
+        std::vector<unsigned> liveTriangles(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            liveTriangles[indices[i]]++;
+
+        std::vector<unsigned> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+
+        std::vector<unsigned> adjacency(triangleCount * 3);
+        std::vector<unsigned> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int k = 0; k < 3; k++)
+                adjacency[fill[indices[t * 3 + k]]++] = (unsigned)t;
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> scoreOfVertex(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            scoreOfVertex[v] = vertexScore(tables, -1, liveTriangles[v]);
+
+        std::vector<float> scoreOfTriangle(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+            scoreOfTriangle[t] = scoreOfVertex[indices[t * 3]] + scoreOfVertex[indices[t * 3 + 1]] +
+                scoreOfVertex[indices[t * 3 + 2]];
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<GLuint> result;
+        result.reserve(triangleCount * 3);
+
+        //room for the new triangle's vertices pushing older ones out
+        std::vector<GLuint> cache;
+        std::vector<GLuint> nextCache;
+        cache.reserve(kCacheSize + 3);
+        nextCache.reserve(kCacheSize + 3);
+
+        size_t cursor = 0;
+        int best = 0;
+
+        for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+
+            //nothing in the cache is usable - restart from the next triangle in input order
+            if (best < 0) {
+
+                while (emitted[cursor])
+                    cursor++;
+                best = (int)cursor;
+            }
+
+            const GLuint* triangle = &indices[(size_t)best * 3];
+            result.insert(result.end(), triangle, triangle + 3);
+            emitted[best] = true;
+
+            //drop the triangle from its vertices' live lists
+            for (int k = 0; k < 3; k++) {
+
+                GLuint v = triangle[k];
+                unsigned* begin = &adjacency[adjacencyOffset[v]];
+                unsigned* end = begin + liveTriangles[v];
+                unsigned* it = std::find(begin, end, (unsigned)best);
+                std::swap(*it, *(end - 1));
+                liveTriangles[v]--;
+            }
+
+            //move the triangle's vertices to the front of the LRU
+            nextCache.assign(triangle, triangle + 3);
+            for (GLuint v : cache)
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                    nextCache.push_back(v);
+
+            for (size_t i = 0; i < nextCache.size(); i++) {
+
+                GLuint v = nextCache[i];
+                cachePosition[v] = i < (size_t)kCacheSize ? (int)i : -1;
+
+                float score = vertexScore(tables, cachePosition[v], liveTriangles[v]);
+                float delta = score - scoreOfVertex[v];
+                scoreOfVertex[v] = score;
+
+                for (unsigned j = 0; j < liveTriangles[v]; j++)
+                    scoreOfTriangle[adjacency[adjacencyOffset[v] + j]] += delta;
+            }
+
+            if (nextCache.size() > (size_t)kCacheSize)
+                nextCache.resize(kCacheSize);
+            cache.swap(nextCache);
+
+            //best candidate among triangles touching the cache
+            best = -1;
+            float bestScore = -1.0f;
+            for (GLuint v : cache) {
+
+                for (unsigned j = 0; j < liveTriangles[v]; j++) {
+
+                    unsigned t = adjacency[adjacencyOffset[v] + j];
+                    if (scoreOfTriangle[t] > bestScore) {
+
+                        bestScore = scoreOfTriangle[t];
+                        best = (int)t;
+                    }
+                }
+            }
+        }
+
+        indices.swap(result);
+    }
+
+    void MeshOptimizer::OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<gps::Vertex>& vertices,
+                                         float threshold) {
+
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        std::vector<unsigned> cacheTime(vertices.size(), 0);
+        unsigned timestamp = statsCacheSize + 1;
+
+        //hard boundaries - a triangle missing on all three vertices starts over anyway
+        std::vector<size_t> hardClusters;
+        for (size_t t = 0; t < triangleCount; t++)
+            if (simulateTriangle(&indices[t * 3], cacheTime, timestamp, statsCacheSize) == 3 || t == 0)
+                hardClusters.push_back(t);
+        hardClusters.push_back(triangleCount);
+
+        //soft boundaries - split a cluster again once the triangles so far already
+        //reach its own ACMR within threshold (each split flushes the cache)
+        std::vector<size_t> clusters;
+        for (size_t c = 0; c + 1 < hardClusters.size(); c++) {
+
+            size_t start = hardClusters[c];
+            size_t end = hardClusters[c + 1];
+
+            timestamp += statsCacheSize + 1;
+            unsigned clusterMisses = 0;
+            for (size_t t = start; t < end; t++)
+                clusterMisses += simulateTriangle(&indices[t * 3], cacheTime, timestamp, statsCacheSize);
+
+            float clusterThreshold = threshold * (float)clusterMisses / (float)(end - start);
+
+            clusters.push_back(start);
+            timestamp += statsCacheSize + 1;
+            unsigned runningMisses = 0;
+            unsigned runningTriangles = 0;
+
+            for (size_t t = start; t + 1 < end; t++) {
+
+                runningMisses += simulateTriangle(&indices[t * 3], cacheTime, timestamp, statsCacheSize);
+                runningTriangles++;
+
+                if ((float)runningMisses / (float)runningTriangles <= clusterThreshold) {
+
+                    clusters.push_back(t + 1);
+                    timestamp += statsCacheSize + 1;
+                    runningMisses = 0;
+                    runningTriangles = 0;
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+
+        glm::vec3 meshCentroid(0.0f);
+        for (GLuint index : indices)
+            meshCentroid += vertices[index].Position;
+        meshCentroid /= (float)indices.size();
+
+        //clusters facing away from the centre are drawn first as they are likely to occlude the rest
+        const size_t clusterCount = clusters.size() - 1;
+        std::vector<float> sortKey(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+
+            glm::vec3 centroid(0.0f);
+            glm::vec3 normal(0.0f);
+            float area = 0.0f;
+
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+
+                const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+
+                glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                float triangleArea = glm::length(n);
+
+                centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                normal += n;
+                area += triangleArea;
+            }
+
+            centroid = area > 0.0f ? centroid / area : vertices[indices[clusters[c] * 3]].Position;
+            float normalLength = glm::length(normal);
+            sortKey[c] = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+        }
+
+        std::vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+            order[c] = c;
+        std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) {
+            return sortKey[a] > sortKey[b];
+        });
+
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        for (size_t c : order)
+            result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+
+        indices.swap(result);
+    }
+
+    void MeshOptimizer::OptimizeVertexFetch(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices) {
+
+        const GLuint unassigned = ~0u;
+        std::vector<GLuint> remap(vertices.size(), unassigned);
+        GLuint next = 0;
+
+        for (GLuint& index : indices) {
+
+            if (remap[index] == unassigned)
+                remap[index] = next++;
+            index = remap[index];
+        }
+
+        //unreferenced vertices keep their relative order at the end
+        for (GLuint& slot : remap)
+            if (slot == unassigned)
+                slot = next++;
+
+        std::vector<gps::Vertex> result(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++)
+            result[remap[v]] = vertices[v];
+
+        vertices.swap(result);
+    }
+
+    void MeshOptimizer::Optimize(gps::MeshData& mesh, VertexCacheStats& before, VertexCacheStats& after) {
+
+        before = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+        OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+        OptimizeOverdraw(mesh.indices, mesh.vertices);
+        OptimizeVertexFetch(mesh.vertices, mesh.indices);
+
+        after = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+    }
+}
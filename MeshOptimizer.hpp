@@ -0,0 +1,48 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    struct VertexCacheStats {
+
+        // average cache miss ratio - vertices transformed per triangle (0.5 to 3)
+        float acmr;
+        // average transform to vertex ratio - vertices transformed per unique vertex (1 is ideal)
+        float atvr;
+    };
+
+    // Post-load reordering of indexed triangle lists: triangles are first
+    // sorted for post-transform cache hits (Forsyth's linear-speed algorithm),
+    // then clusters of them are ordered outside-in to cut overdraw without
+    // giving back much of the cache win, and finally vertices are renumbered
+    // in first-use order so vertex fetch walks memory linearly.
+    class MeshOptimizer {
+
+    public:
+        // Set to false to keep the exporter's triangle order
+        static bool enabled;
+
+        // FIFO size used to compute the statistics
+        static const unsigned statsCacheSize = 16;
+
+        static VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount,
+                                                   unsigned cacheSize = statsCacheSize);
+
+        static void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+
+        // threshold is how much worse than the cache-optimised ACMR a cluster may get
+        static void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<gps::Vertex>& vertices,
+                                     float threshold = 1.05f);
+
+        static void OptimizeVertexFetch(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices);
+
+        // Runs the three passes in order and reports the cache statistics around them
+        static void Optimize(gps::MeshData& mesh, VertexCacheStats& before, VertexCacheStats& after);
+    };
+}
+
+#endif /* MeshOptimizer_hpp */
@@ -1,36 +1,153 @@
 #include "Model3D.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "ObjParser.hpp"
+
+#include <chrono>
+#include <sstream>
+#include <unordered_map>
 
 namespace gps {
 
+	// Hashes the (position, normal, texcoord) index triple of a face corner so
+	// corners referencing the same attributes can be welded into one vertex
+	struct IndexHash {
+
+		size_t operator()(const tinyobj::index_t& idx) const {
+
+			size_t h = std::hash<int>()(idx.vertex_index);
+			h ^= std::hash<int>()(idx.normal_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= std::hash<int>()(idx.texcoord_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	struct IndexEqual {
+
+		bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const {
+
+			return a.vertex_index == b.vertex_index &&
+				a.normal_index == b.normal_index &&
+				a.texcoord_index == b.texcoord_index;
+		}
+	};
+
 	void Model3D::LoadModel(std::string fileName) {
 
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)	{
 
-		ReadOBJ(fileName, basePath);
+		ParseModel(fileName, basePath);
+		UploadModel();
+	}
+
+	void Model3D::ParseModel(std::string fileName) {
+
+        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+		ParseModel(fileName, basePath);
+	}
+
+	void Model3D::ParseModel(std::string fileName, std::string basePath) {
+
+		auto start = std::chrono::steady_clock::now();
+
+		pendingFileName = fileName;
+		pendingMeshes.clear();
+		pendingFromCache = gps::MeshCache::Read(fileName, pendingMeshes);
+
+		if (!pendingFromCache) {
+
+			ReadOBJ(fileName, basePath, pendingMeshes);
+			if (gps::MeshOptimizer::enabled)
+				OptimizeMeshes(pendingMeshes);
+			gps::MeshCache::Write(fileName, pendingMeshes);
+		}
+
+		//queue decoding of every referenced image
+		for (size_t i = 0; i < pendingMeshes.size(); i++) {
+
+			for (size_t t = 0; t < pendingMeshes[i].textures.size(); t++) {
+
+				gps::TextureCache::Instance().RequestDecode(pendingMeshes[i].textures[t].path);
+			}
+		}
+
+		parseTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void Model3D::UploadModel() {
+
+		auto start = std::chrono::steady_clock::now();
+
+		SetupMeshes(pendingMeshes);
+
+		double uploadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		std::ostringstream message;
+		message << "Loaded " << pendingFileName << (pendingFromCache ? " from binary cache" : " from OBJ")
+			<< " : parse " << parseTime << " ms, upload " << uploadTime << " ms" << std::endl;
+		std::cout << message.str();
+
+		pendingMeshes.clear();
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram) {
+	void Model3D::Draw(gps::Shader& shaderProgram) {
 
 		for (int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shaderProgram);
 	}
 
+	// Queue each mesh from the model
+	void Model3D::Submit(gps::RenderQueue& queue, gps::Shader& shaderProgram, const glm::mat4& model) {
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].Submit(queue, shaderProgram, model);
+	}
+
+	// Queue each mesh from the model for a depth-only pass
+	void Model3D::SubmitDepth(gps::RenderQueue& queue, gps::Shader& shaderProgram, const glm::mat4& model) {
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].SubmitDepth(queue, shaderProgram, model);
+	}
+
+	void Model3D::AddInstances(const glm::mat4& model, std::vector<gps::MeshInstance>& instances) {
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			instances.push_back(gps::MeshInstance(&meshes[i], model));
+	}
+
+	// Queue each mesh from the model for instanced drawing
+	void Model3D::SubmitInstanced(gps::RenderQueue& queue, gps::Shader& shaderProgram, const gps::InstanceBuffer& instances) {
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].SubmitInstanced(queue, shaderProgram, instances);
+	}
+
+	void Model3D::SubmitDepthInstanced(gps::RenderQueue& queue, gps::Shader& shaderProgram, const gps::InstanceBuffer& instances) {
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].SubmitDepthInstanced(queue, shaderProgram, instances);
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
-	void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
+	void Model3D::ReadOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData) {
 
-        std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		bool ret;
+		if (gps::ObjParser::enabled)
+			ret = gps::ObjParser::Load(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str());
+		else
+			ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
 
 		if (!err.empty()) {
 
@@ -43,15 +160,27 @@ namespace gps {
 			exit(1);
 		}
 
-		std::cout << "# of shapes    : " << shapes.size() << std::endl;
-		std::cout << "# of materials : " << materials.size() << std::endl;
+		size_t totalVertices = 0;
+		size_t totalIndices = 0;
 
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
 
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			gps::MeshData currentMesh;
+			std::vector<gps::Vertex>& vertices = currentMesh.vertices;
+			std::vector<GLuint>& indices = currentMesh.indices;
+			std::vector<gps::Texture>& textures = currentMesh.textures;
+
+			currentMesh.material.ambient = glm::vec3(0.0f);
+			currentMesh.material.diffuse = glm::vec3(0.0f);
+			currentMesh.material.specular = glm::vec3(0.0f);
+			currentMesh.boundsMin = glm::vec3(0.0f);
+			currentMesh.boundsMax = glm::vec3(0.0f);
+
+			// Shared vertex pool - each unique index triple is emitted only once
+			std::unordered_map<tinyobj::index_t, GLuint, IndexHash, IndexEqual> uniqueVertices;
+			uniqueVertices.reserve(shapes[s].mesh.indices.size());
+			indices.reserve(shapes[s].mesh.indices.size());
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -68,15 +197,30 @@ namespace gps {
 					// access to vertex
 					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 
+					auto found = uniqueVertices.find(idx);
+					if (found != uniqueVertices.end()) {
+
+						//already emitted vertex
+						indices.push_back(found->second);
+						continue;
+					}
+
 					float vx = attrib.vertices[3 * idx.vertex_index + 0];
 					float vy = attrib.vertices[3 * idx.vertex_index + 1];
 					float vz = attrib.vertices[3 * idx.vertex_index + 2];
-					float nx = attrib.normals[3 * idx.normal_index + 0];
-					float ny = attrib.normals[3 * idx.normal_index + 1];
-					float nz = attrib.normals[3 * idx.normal_index + 2];
+					float nx = 0.0f;
+					float ny = 0.0f;
+					float nz = 0.0f;
 					float tx = 0.0f;
 					float ty = 0.0f;
 
+					if (idx.normal_index != -1) {
+
+						nx = attrib.normals[3 * idx.normal_index + 0];
+						ny = attrib.normals[3 * idx.normal_index + 1];
+						nz = attrib.normals[3 * idx.normal_index + 2];
+					}
+
 					if (idx.texcoord_index != -1) {
 
 						tx = attrib.texcoords[2 * idx.texcoord_index + 0];
@@ -92,14 +236,27 @@ namespace gps {
 					currentVertex.Normal = vertexNormal;
 					currentVertex.TexCoords = vertexTexCoords;
 
+					if (vertices.empty()) {
+
+						currentMesh.boundsMin = vertexPosition;
+						currentMesh.boundsMax = vertexPosition;
+					}
+					currentMesh.boundsMin = glm::min(currentMesh.boundsMin, vertexPosition);
+					currentMesh.boundsMax = glm::max(currentMesh.boundsMax, vertexPosition);
+
+					GLuint vertexIndex = (GLuint)vertices.size();
+					uniqueVertices.emplace(idx, vertexIndex);
 					vertices.push_back(currentVertex);
 
-					indices.push_back((GLuint)(index_offset + v));
+					indices.push_back(vertexIndex);
 				}
 
 				index_offset += fv;
 			}
 
+			totalVertices += vertices.size();
+			totalIndices += indices.size();
+
 			// get material id
 			// Only try to read materials if the .mtl file is present
 			size_t a = shapes[s].mesh.material_ids.size();
@@ -109,7 +266,7 @@ namespace gps {
 				materialId = shapes[s].mesh.material_ids[0];
 				if (materialId != -1) {
 
-					gps::Material currentMaterial;
+					gps::Material& currentMaterial = currentMesh.material;
 					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
 					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
 					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
@@ -120,7 +277,9 @@ namespace gps {
 					if (!ambientTexturePath.empty()) {
 
 						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
+						currentTexture.id = 0;
+						currentTexture.type = "ambientTexture";
+						currentTexture.path = basePath + ambientTexturePath;
 						textures.push_back(currentTexture);
 					}
 
@@ -130,7 +289,9 @@ namespace gps {
 					if (!diffuseTexturePath.empty()) {
 
 						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
+						currentTexture.id = 0;
+						currentTexture.type = "diffuseTexture";
+						currentTexture.path = basePath + diffuseTexturePath;
 						textures.push_back(currentTexture);
 					}
 
@@ -140,117 +301,120 @@ namespace gps {
 					if (!specularTexturePath.empty()) {
 
 						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
+						currentTexture.id = 0;
+						currentTexture.type = "specularTexture";
+						currentTexture.path = basePath + specularTexturePath;
 						textures.push_back(currentTexture);
 					}
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			meshData.push_back(std::move(currentMesh));
 		}
+
+		std::ostringstream message;
+		message << "Loading : " << fileName << std::endl;
+		message << "# of shapes    : " << shapes.size() << std::endl;
+		message << "# of materials : " << materials.size() << std::endl;
+		message << "# of vertices  : " << totalVertices << " (" << totalIndices << " indices)" << std::endl;
+		std::cout << message.str();
 	}
 
-	// Retrieves a texture associated with the object - by its name and type
-	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
+	// Reorders triangles and vertices of every mesh for the GPU caches
+	void Model3D::OptimizeMeshes(std::vector<gps::MeshData>& meshData) {
 
-			for (int i = 0; i < loadedTextures.size(); i++) {
+		std::ostringstream message;
+		message << "Optimized " << pendingFileName << " (ACMR/ATVR, FIFO " << gps::MeshOptimizer::statsCacheSize << ")" << std::endl;
+		message.precision(3);
 
-				if (loadedTextures[i].path == path)	{
+		for (size_t i = 0; i < meshData.size(); i++) {
 
-					//already loaded texture
-					return loadedTextures[i];
-				}
-			}
+			gps::VertexCacheStats before, after;
+			gps::MeshOptimizer::Optimize(meshData[i], before, after);
 
-			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
-			currentTexture.type = std::string(type);
-			currentTexture.path = path;
+			message << "  mesh " << i << " (" << meshData[i].indices.size() / 3 << " triangles) : ACMR "
+				<< before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+		}
 
-			loadedTextures.push_back(currentTexture);
+		std::cout << message.str();
+	}
 
-			return currentTexture;
-		}
+	// Loads the referenced textures and creates the GPU meshes
+	void Model3D::SetupMeshes(std::vector<gps::MeshData>& meshData) {
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
+		for (size_t i = 0; i < meshData.size(); i++) {
 
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
+			std::vector<gps::Texture> textures;
+			for (size_t t = 0; t < meshData[i].textures.size(); t++) {
 
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
-			return false;
-		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
+				textures.push_back(LoadTexture(meshData[i].textures[t].path, meshData[i].textures[t].type));
+			}
+
+			meshes.push_back(gps::Mesh(meshData[i].vertices, meshData[i].indices, textures));
 		}
+	}
 
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
+	// Retrieves a texture associated with the object - by its name and type
+	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
+
+			auto loaded = loadedTextures.find(path);
+			if (loaded != loadedTextures.end()) {
 
-		for (int row = 0; row < half_height; row++) {
+				//already loaded texture
+				return loaded->second;
+			}
 
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
+			gps::Texture currentTexture;
+			currentTexture.id = gps::TextureCache::Instance().Acquire(path);
+			currentTexture.type = std::string(type);
+			currentTexture.path = path;
 
-			for (int col = 0; col < width_in_bytes; col++) {
+			loadedTextures[path] = currentTexture;
 
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
+			return currentTexture;
 		}
 
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		return textureID;
+	Model3D::~Model3D() {
+
+        //the TextureCache may already be gone at exit, Release drops the references
+        ReleaseBuffers();
 	}
 
-	Model3D::~Model3D() {
+	void Model3D::Release() {
 
-        for (size_t i = 0; i < loadedTextures.size(); i++) {
+        for (auto& loaded : loadedTextures) {
 
-            glDeleteTextures(1, &loadedTextures.at(i).id);
+            gps::TextureCache::Instance().Release(loaded.second.id);
         }
+        loadedTextures.clear();
+
+        ReleaseBuffers();
+	}
+
+	void Model3D::ReleaseBuffers() {
 
         for (size_t i = 0; i < meshes.size(); i++) {
 
+            //arena meshes share the GeometryArena buffers and VAO
+            if (meshes.at(i).getBuffers().VBO == 0)
+                continue;
+
             GLuint VBO = meshes.at(i).getBuffers().VBO;
             GLuint EBO = meshes.at(i).getBuffers().EBO;
             GLuint VAO = meshes.at(i).getBuffers().VAO;
             glDeleteBuffers(1, &VBO);
             glDeleteBuffers(1, &EBO);
             glDeleteVertexArrays(1, &VAO);
+
+            //position-only stream, when the mesh has its own
+            gps::Buffers depthBuffers = meshes.at(i).getDepthBuffers();
+            if (depthBuffers.VBO == 0)
+                continue;
+
+            glDeleteBuffers(1, &depthBuffers.VBO);
+            glDeleteBuffers(1, &depthBuffers.EBO);
+            glDeleteVertexArrays(1, &depthBuffers.VAO);
         }
+        meshes.clear();
 	}
 }
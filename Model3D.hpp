@@ -2,12 +2,17 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "InstanceBuffer.hpp"
+#include "RenderQueue.hpp"
+#include "SceneBVH.hpp"
+#include "TextureCache.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
 #include <iostream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace gps {
@@ -21,22 +26,63 @@ namespace gps {
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// CPU stage of loading - safe to run on a worker thread. Decoding of the
+		// referenced images starts right away on the TextureCache workers.
+		// Images already loaded by another model are not decoded again.
+		void ParseModel(std::string fileName);
+
+		void ParseModel(std::string fileName, std::string basePath);
+
+		// GL stage of loading - must run on the thread owning the context.
+		// Textures show a placeholder until TextureCache::Update streams them.
+		void UploadModel();
+
+		void Draw(gps::Shader& shaderProgram);
+
+		// Queues every mesh for a sorted draw with the given transform
+		void Submit(gps::RenderQueue& queue, gps::Shader& shaderProgram, const glm::mat4& model);
+
+		// As Submit, from the position-only streams of the meshes
+		void SubmitDepth(gps::RenderQueue& queue, gps::Shader& shaderProgram, const glm::mat4& model);
+
+		// Places every mesh with the given transform, for culling
+		void AddInstances(const glm::mat4& model, std::vector<gps::MeshInstance>& instances);
+
+		// Queues every mesh once, drawn for each instance in the buffer
+		void SubmitInstanced(gps::RenderQueue& queue, gps::Shader& shaderProgram, const gps::InstanceBuffer& instances);
+
+		void SubmitDepthInstanced(gps::RenderQueue& queue, gps::Shader& shaderProgram, const gps::InstanceBuffer& instances);
+
+		// Drops the TextureCache references and deletes the mesh buffers; call
+		// while the context is alive, the destructor leaves the cache alone
+		void Release();
 
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
-		// Associated textures
-        std::vector<gps::Texture> loadedTextures;
+		// Associated textures, by path - each holds a TextureCache reference
+        std::unordered_map<std::string, gps::Texture> loadedTextures;
+
+		// Parsed data waiting for UploadModel
+		std::string pendingFileName;
+		std::vector<gps::MeshData> pendingMeshes;
+		bool pendingFromCache;
+		double parseTime;
 
 		// Does the parsing of the .obj file and fills in the data structure
-		void ReadOBJ(std::string fileName, std::string basePath);
+		void ReadOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData);
+
+		// Reorders triangles and vertices of every mesh for the GPU caches
+		void OptimizeMeshes(std::vector<gps::MeshData>& meshData);
+
+		// Loads the referenced textures and creates the GPU meshes
+		void SetupMeshes(std::vector<gps::MeshData>& meshData);
 
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Deletes the buffers and VAOs of the meshes outside the GeometryArena
+		void ReleaseBuffers();
     };
 }
 
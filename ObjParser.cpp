@@ -0,0 +1,566 @@
+#include "ObjParser.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gps {
+
+    bool ObjParser::enabled = true;
+
+    namespace {
+
+        //smallest slice of the file worth handing to its own thread
+        const size_t kMinChunkBytes = 128 * 1024;
+
+        //read-only view of a whole file
+        class MappedFile {
+
+        public:
+            explicit MappedFile(const char* fileName) {
+#if defined(_WIN32)
+                file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                   FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+                if (file == INVALID_HANDLE_VALUE)
+                    return;
+                LARGE_INTEGER fileSize;
+                if (!GetFileSizeEx(file, &fileSize))
+                    return;
+                size = (size_t)fileSize.QuadPart;
+                opened = true;
+                if (size == 0)
+                    return;
+                mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+                if (mapping == NULL) {
+                    opened = false;
+                    return;
+                }
+                data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                opened = data != NULL;
+#else
+                fd = open(fileName, O_RDONLY);
+                if (fd < 0)
+                    return;
+                struct stat st;
+                if (fstat(fd, &st) != 0)
+                    return;
+                size = (size_t)st.st_size;
+                opened = true;
+                if (size == 0)
+                    return;
+                void* view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (view == MAP_FAILED) {
+                    opened = false;
+                    return;
+                }
+                madvise(view, size, MADV_SEQUENTIAL);
+                data = (const char*)view;
+#endif
+            }
+
+            ~MappedFile() {
+#if defined(_WIN32)
+                if (data != NULL)
+                    UnmapViewOfFile(data);
+                if (mapping != NULL)
+                    CloseHandle(mapping);
+                if (file != INVALID_HANDLE_VALUE)
+                    CloseHandle(file);
+#else
+                if (data != NULL)
+                    munmap((void*)data, size);
+                if (fd >= 0)
+                    close(fd);
+#endif
+            }
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            bool IsOpen() const { return opened; }
+            const char* Data() const { return data; }
+            size_t Size() const { return size; }
+
+        private:
+#if defined(_WIN32)
+            HANDLE file = INVALID_HANDLE_VALUE;
+            HANDLE mapping = NULL;
+#else
+            int fd = -1;
+#endif
+            const char* data = NULL;
+            size_t size = 0;
+            bool opened = false;
+        };
+
+        enum StatementType : uint8_t {
+            FACE,
+            USEMTL,
+            MTLLIB,
+            GROUP,
+            OBJECT
+        };
+
+        //flags marking negative (relative) indices, resolved during the merge
+        enum : uint8_t {
+            REL_V = 1,
+            REL_VT = 2,
+            REL_VN = 4
+        };
+
+        //zero based indices; relative ones are stored against the chunk's own counts
+        struct Corner {
+            int v, vt, vn;
+            uint8_t relative;
+        };
+
+        //faces reference a run of corners, names point into the mapped file
+        struct Statement {
+            StatementType type;
+            uint32_t first;
+            uint32_t count;
+            const char* text;
+            uint32_t length;
+        };
+
+        struct Chunk {
+            const char* begin;
+            const char* end;
+            std::vector<float> v, vn, vt;
+            std::vector<Corner> corners;
+            std::vector<Statement> statements;
+        };
+
+        inline bool IsSpace(char c) { return c == ' ' || c == '\t'; }
+        inline bool IsDigit(char c) { return (unsigned)(c - '0') < 10u; }
+        inline bool IsTokenEnd(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+        inline char At(const char* p, const char* end, size_t i) {
+            return p + i < end ? p[i] : '\0';
+        }
+
+        inline const char* SkipSpace(const char* p, const char* end) {
+            while (p < end && IsSpace(*p))
+                p++;
+            return p;
+        }
+
+        inline const char* SkipTokenSeparators(const char* p, const char* end) {
+            while (p < end && IsTokenEnd(*p))
+                p++;
+            return p;
+        }
+
+        //same arithmetic as tinyobj's tryParseDouble so both paths agree bit for bit
+        bool ParseDouble(const char* s, const char* end, double* result) {
+            if (s >= end)
+                return false;
+
+            double mantissa = 0.0;
+            int exponent = 0;
+            char sign = '+';
+            const char* curr = s;
+            int read = 0;
+
+            if (*curr == '+' || *curr == '-')
+                sign = *curr++;
+            else if (!IsDigit(*curr))
+                return false;
+
+            while (curr < end && IsDigit(*curr)) {
+                mantissa *= 10;
+                mantissa += (int)(*curr - '0');
+                curr++;
+                read++;
+            }
+            if (read == 0)
+                return false;
+
+            if (curr < end && *curr == '.') {
+                static const double powLut[] = { 1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001 };
+                const int lutEntries = sizeof powLut / sizeof powLut[0];
+                curr++;
+                read = 1;
+                while (curr < end && IsDigit(*curr)) {
+                    mantissa += (int)(*curr - '0') * (read < lutEntries ? powLut[read] : pow(10.0, -read));
+                    read++;
+                    curr++;
+                }
+            }
+
+            if (curr < end && (*curr == 'e' || *curr == 'E')) {
+                char expSign = '+';
+                curr++;
+                if (curr < end && (*curr == '+' || *curr == '-'))
+                    expSign = *curr++;
+                else if (curr >= end || !IsDigit(*curr))
+                    return false;
+
+                read = 0;
+                while (curr < end && IsDigit(*curr)) {
+                    exponent *= 10;
+                    exponent += (int)(*curr - '0');
+                    curr++;
+                    read++;
+                }
+                exponent *= (expSign == '+' ? 1 : -1);
+                if (read == 0)
+                    return false;
+            }
+
+            *result = (sign == '+' ? 1 : -1) *
+                (exponent ? ldexp(mantissa * pow(5.0, exponent), exponent) : mantissa);
+            return true;
+        }
+
+        inline float ParseFloat(const char** p, const char* end) {
+            const char* s = SkipSpace(*p, end);
+            const char* e = s;
+            while (e < end && !IsTokenEnd(*e))
+                e++;
+            double value = 0.0;
+            ParseDouble(s, e, &value);
+            *p = e;
+            return (float)value;
+        }
+
+        //atoi followed by a skip to the next '/', blank or line end
+        inline int ParseIndex(const char** p, const char* end) {
+            const char* s = *p;
+            int sign = 1;
+            int value = 0;
+            if (s < end && (*s == '+' || *s == '-')) {
+                if (*s == '-')
+                    sign = -1;
+                s++;
+            }
+            while (s < end && IsDigit(*s))
+                value = value * 10 + (*s++ - '0');
+            while (s < end && *s != '/' && !IsTokenEnd(*s))
+                s++;
+            *p = s;
+            return sign * value;
+        }
+
+        //tinyobj's fixIndex, with negative indices kept relative to the chunk
+        inline int FixIndex(int idx, size_t localCount, uint8_t flag, uint8_t& relative) {
+            if (idx > 0)
+                return idx - 1;
+            if (idx == 0)
+                return 0;
+            relative |= flag;
+            return (int)localCount + idx;
+        }
+
+        Corner ParseCorner(const char** p, const char* end, const Chunk& chunk) {
+            Corner corner = { -1, -1, -1, 0 };
+            const size_t vCount = chunk.v.size() / 3;
+            const size_t vnCount = chunk.vn.size() / 3;
+            const size_t vtCount = chunk.vt.size() / 2;
+
+            corner.v = FixIndex(ParseIndex(p, end), vCount, REL_V, corner.relative);
+            if (At(*p, end, 0) != '/')
+                return corner;
+            (*p)++;
+
+            // i//k
+            if (At(*p, end, 0) == '/') {
+                (*p)++;
+                corner.vn = FixIndex(ParseIndex(p, end), vnCount, REL_VN, corner.relative);
+                return corner;
+            }
+
+            // i/j/k or i/j
+            corner.vt = FixIndex(ParseIndex(p, end), vtCount, REL_VT, corner.relative);
+            if (At(*p, end, 0) != '/')
+                return corner;
+            (*p)++;
+            corner.vn = FixIndex(ParseIndex(p, end), vnCount, REL_VN, corner.relative);
+            return corner;
+        }
+
+        //first blank separated word after the keyword (what sscanf("%s") would read)
+        void AddNameStatement(Chunk& chunk, StatementType type, const char* p, const char* end) {
+            p = SkipTokenSeparators(p, end);
+            const char* e = p;
+            while (e < end && !IsSpace(*e) && *e != '\r')
+                e++;
+            Statement statement = { type, 0, 0, p, (uint32_t)(e - p) };
+            chunk.statements.push_back(statement);
+        }
+
+        void ParseLine(Chunk& chunk, const char* p, const char* end) {
+            p = SkipSpace(p, end);
+            if (p >= end || *p == '#')
+                return;
+
+            const char c0 = p[0];
+            const char c1 = At(p, end, 1);
+
+            if (c0 == 'v') {
+                if (IsSpace(c1)) {
+                    p += 2;
+                    chunk.v.push_back(ParseFloat(&p, end));
+                    chunk.v.push_back(ParseFloat(&p, end));
+                    chunk.v.push_back(ParseFloat(&p, end));
+                    return;
+                }
+                if (c1 == 'n' && IsSpace(At(p, end, 2))) {
+                    p += 3;
+                    chunk.vn.push_back(ParseFloat(&p, end));
+                    chunk.vn.push_back(ParseFloat(&p, end));
+                    chunk.vn.push_back(ParseFloat(&p, end));
+                    return;
+                }
+                if (c1 == 't' && IsSpace(At(p, end, 2))) {
+                    p += 3;
+                    chunk.vt.push_back(ParseFloat(&p, end));
+                    chunk.vt.push_back(ParseFloat(&p, end));
+                    return;
+                }
+                return;
+            }
+
+            if (c0 == 'f' && IsSpace(c1)) {
+                p = SkipSpace(p + 2, end);
+                Statement face = { FACE, (uint32_t)chunk.corners.size(), 0, NULL, 0 };
+                while (p < end) {
+                    chunk.corners.push_back(ParseCorner(&p, end, chunk));
+                    p = SkipTokenSeparators(p, end);
+                }
+                face.count = (uint32_t)chunk.corners.size() - face.first;
+                chunk.statements.push_back(face);
+                return;
+            }
+
+            if (end - p > 6 && IsSpace(p[6])) {
+                if (strncmp(p, "usemtl", 6) == 0) {
+                    AddNameStatement(chunk, USEMTL, p + 7, end);
+                    return;
+                }
+                if (strncmp(p, "mtllib", 6) == 0) {
+                    AddNameStatement(chunk, MTLLIB, p + 7, end);
+                    return;
+                }
+            }
+
+            if (c0 == 'g' && IsSpace(c1)) {
+                AddNameStatement(chunk, GROUP, p + 2, end);
+                return;
+            }
+
+            if (c0 == 'o' && IsSpace(c1)) {
+                AddNameStatement(chunk, OBJECT, p + 2, end);
+                return;
+            }
+        }
+
+        void ParseChunk(Chunk& chunk) {
+            //rough per-chunk reservation to avoid most regrowth
+            const size_t bytes = (size_t)(chunk.end - chunk.begin);
+            chunk.corners.reserve(bytes / 24);
+            chunk.statements.reserve(bytes / 64);
+
+            const char* p = chunk.begin;
+            while (p < chunk.end) {
+                const char* eol = (const char*)memchr(p, '\n', (size_t)(chunk.end - p));
+                if (eol == NULL)
+                    eol = chunk.end;
+                const char* lineEnd = eol;
+                if (lineEnd > p && lineEnd[-1] == '\r')
+                    lineEnd--;
+                ParseLine(chunk, p, lineEnd);
+                p = eol + 1;
+            }
+        }
+
+        //one face group entry: which chunk it came from and its face statement
+        struct FaceRef {
+            size_t chunk;
+            const Statement* face;
+        };
+
+        struct IndexBase {
+            int v, vt, vn;
+        };
+
+        inline tinyobj::index_t Resolve(const Corner& corner, const IndexBase& base) {
+            tinyobj::index_t idx;
+            idx.vertex_index = corner.v + ((corner.relative & REL_V) ? base.v : 0);
+            idx.texcoord_index = corner.vt + ((corner.relative & REL_VT) ? base.vt : 0);
+            idx.normal_index = corner.vn + ((corner.relative & REL_VN) ? base.vn : 0);
+            return idx;
+        }
+
+        //mirrors tinyobj's exportFaceGroupToShape with triangulation on
+        bool ExportFaceGroup(tinyobj::shape_t& shape, const std::vector<FaceRef>& faceGroup,
+                             const std::vector<Chunk>& chunks, const std::vector<IndexBase>& bases,
+                             int materialId, const std::string& name) {
+            if (faceGroup.empty())
+                return false;
+
+            for (const FaceRef& ref : faceGroup) {
+                const Corner* corners = &chunks[ref.chunk].corners[ref.face->first];
+                const IndexBase& base = bases[ref.chunk];
+                const uint32_t count = ref.face->count;
+
+                //points and lines produce no triangles
+                if (count < 3)
+                    continue;
+
+                const tinyobj::index_t i0 = Resolve(corners[0], base);
+                tinyobj::index_t i2 = Resolve(corners[1], base);
+                for (uint32_t k = 2; k < count; k++) {
+                    const tinyobj::index_t i1 = i2;
+                    i2 = Resolve(corners[k], base);
+                    shape.mesh.indices.push_back(i0);
+                    shape.mesh.indices.push_back(i1);
+                    shape.mesh.indices.push_back(i2);
+                    shape.mesh.num_face_vertices.push_back(3);
+                    shape.mesh.material_ids.push_back(materialId);
+                }
+            }
+
+            shape.name = name;
+            return true;
+        }
+    }
+
+    bool ObjParser::Load(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                         std::vector<tinyobj::material_t>* materials, std::string* err,
+                         const char* fileName, const char* basePath) {
+
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+
+        MappedFile file(fileName);
+        if (!file.IsOpen()) {
+            if (err)
+                *err = std::string("Cannot open file [") + fileName + "]\n";
+            return false;
+        }
+
+        const char* data = file.Data();
+        const size_t size = file.Size();
+
+        //split at line boundaries, at most one chunk per hardware thread
+        size_t chunkCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+        chunkCount = std::max<size_t>(1, std::min(chunkCount, size / kMinChunkBytes));
+
+        std::vector<Chunk> chunks(chunkCount);
+        const char* begin = data;
+        for (size_t i = 0; i < chunkCount; i++) {
+            const char* end = data + size;
+            if (i + 1 < chunkCount) {
+                const char* split = std::max(begin, data + size * (i + 1) / chunkCount);
+                const char* eol = (const char*)memchr(split, '\n', (size_t)(data + size - split));
+                end = eol ? eol + 1 : data + size;
+            }
+            chunks[i].begin = begin;
+            chunks[i].end = end;
+            begin = end;
+        }
+
+        //the caller's thread takes the first chunk
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < chunkCount; i++)
+            workers.emplace_back(ParseChunk, std::ref(chunks[i]));
+        if (size > 0)
+            ParseChunk(chunks[0]);
+        for (std::thread& worker : workers)
+            worker.join();
+
+        //attribute offsets of each chunk in the merged arrays
+        std::vector<IndexBase> bases(chunkCount);
+        size_t vSize = 0, vnSize = 0, vtSize = 0;
+        for (size_t i = 0; i < chunkCount; i++) {
+            bases[i].v = (int)(vSize / 3);
+            bases[i].vn = (int)(vnSize / 3);
+            bases[i].vt = (int)(vtSize / 2);
+            vSize += chunks[i].v.size();
+            vnSize += chunks[i].vn.size();
+            vtSize += chunks[i].vt.size();
+        }
+        attrib->vertices.reserve(vSize);
+        attrib->normals.reserve(vnSize);
+        attrib->texcoords.reserve(vtSize);
+        for (const Chunk& chunk : chunks) {
+            attrib->vertices.insert(attrib->vertices.end(), chunk.v.begin(), chunk.v.end());
+            attrib->normals.insert(attrib->normals.end(), chunk.vn.begin(), chunk.vn.end());
+            attrib->texcoords.insert(attrib->texcoords.end(), chunk.vt.begin(), chunk.vt.end());
+        }
+
+        //replay the statements in file order with tinyobj's shape/material rules
+        std::string basePathString = basePath ? basePath : "";
+        tinyobj::MaterialFileReader materialReader(basePathString);
+        std::map<std::string, int> materialMap;
+        int material = -1;
+        std::string name;
+        tinyobj::shape_t shape;
+        std::vector<FaceRef> faceGroup;
+
+        for (size_t c = 0; c < chunkCount; c++) {
+            for (const Statement& statement : chunks[c].statements) {
+                switch (statement.type) {
+                    case FACE: {
+                        FaceRef ref = { c, &statement };
+                        faceGroup.push_back(ref);
+                        break;
+                    }
+                    case USEMTL: {
+                        std::string materialName(statement.text, statement.length);
+                        std::map<std::string, int>::const_iterator it = materialMap.find(materialName);
+                        int newMaterialId = it != materialMap.end() ? it->second : -1;
+                        if (newMaterialId != material) {
+                            ExportFaceGroup(shape, faceGroup, chunks, bases, material, name);
+                            faceGroup.clear();
+                            material = newMaterialId;
+                        }
+                        break;
+                    }
+                    case MTLLIB: {
+                        std::string errMtl;
+                        bool ok = materialReader(std::string(statement.text, statement.length),
+                                                 materials, &materialMap, &errMtl);
+                        if (err)
+                            *err += errMtl;
+                        if (!ok)
+                            return false;
+                        break;
+                    }
+                    case GROUP:
+                    case OBJECT: {
+                        if (ExportFaceGroup(shape, faceGroup, chunks, bases, material, name))
+                            shapes->push_back(shape);
+                        shape = tinyobj::shape_t();
+                        faceGroup.clear();
+                        name.assign(statement.text, statement.length);
+                        break;
+                    }
+                }
+            }
+        }
+
+        bool ret = ExportFaceGroup(shape, faceGroup, chunks, bases, material, name);
+        if (ret || shape.mesh.indices.size())
+            shapes->push_back(shape);
+
+        return true;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef ObjParser_hpp
+#define ObjParser_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Memory-mapped .obj reader producing the same attrib/shapes/materials as
+    // tinyobj::LoadObj (always triangulated). The file is split at line
+    // boundaries and the chunks are tokenized in parallel without allocating
+    // per line, then merged in file order. Materials still go through
+    // tinyobj::MaterialFileReader; `t` tag lines are ignored.
+    class ObjParser {
+
+    public:
+        // Set to false to read through tinyobj::LoadObj instead
+        static bool enabled;
+
+        static bool Load(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                         std::vector<tinyobj::material_t>* materials, std::string* err,
+                         const char* fileName, const char* basePath);
+    };
+}
+
+#endif /* ObjParser_hpp */
@@ -0,0 +1,149 @@
+#include "ProgramCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace gps {
+
+    namespace {
+
+        const char CACHE_MAGIC[8] = { 'G', 'P', 'S', 'P', 'R', 'O', 'G', '\0' };
+        const uint32_t CACHE_VERSION = 1;
+
+        struct CacheHeader {
+
+            char magic[8];
+            uint32_t version;
+            uint32_t binaryFormat;
+            uint64_t key;
+            uint64_t binaryLength;
+        };
+
+        //FNV-1a, continued from hash
+        uint64_t hashBytes(uint64_t hash, const void* data, size_t bytes) {
+
+            const unsigned char* byte = (const unsigned char*)data;
+            for (size_t i = 0; i < bytes; i++) {
+                hash ^= byte[i];
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+        uint64_t hashString(uint64_t hash, const std::string& str) {
+
+            //length first, so the boundary between strings is part of the key
+            uint64_t length = str.size();
+            hash = hashBytes(hash, &length, sizeof(length));
+            return hashBytes(hash, str.data(), str.size());
+        }
+    }
+
+    bool ProgramCache::enabled = true;
+
+    const char* const ProgramCache::directory = "shaders/cache";
+
+    bool ProgramCache::IsSupported() {
+
+        static GLint formatCount = -1;
+        if (formatCount < 0)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
+    }
+
+    uint64_t ProgramCache::Key(const std::string& vertexSource, const std::string& fragmentSource) {
+
+        static std::string driver;
+        if (driver.empty()) {
+
+            const char* renderer = (const char*)glGetString(GL_RENDERER);
+            const char* version = (const char*)glGetString(GL_VERSION);
+            driver = std::string(renderer ? renderer : "") + "\n" + (version ? version : "");
+        }
+
+        uint64_t hash = 14695981039346656037ull;
+        hash = hashBytes(hash, &CACHE_VERSION, sizeof(CACHE_VERSION));
+        hash = hashString(hash, driver);
+        hash = hashString(hash, vertexSource);
+        hash = hashString(hash, fragmentSource);
+        return hash;
+    }
+
+    std::string ProgramCache::CachePath(uint64_t key) {
+
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.progbin", (unsigned long long)key);
+        return std::string(directory) + "/" + name;
+    }
+
+    bool ProgramCache::Load(uint64_t key, GLuint program) {
+
+        if (!enabled || !IsSupported())
+            return false;
+
+        std::ifstream in(CachePath(key), std::ios::binary | std::ios::ate);
+        if (!in)
+            return false;
+
+        size_t size = (size_t)in.tellg();
+        in.seekg(0);
+
+        CacheHeader header;
+        if (size < sizeof(header) || !in.read((char*)&header, sizeof(header)) ||
+            memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+            header.version != CACHE_VERSION ||
+            header.key != key ||
+            header.binaryLength != size - sizeof(header))
+            return false;
+
+        std::vector<char> binary((size_t)header.binaryLength);
+        if (!in.read(binary.data(), binary.size()))
+            return false;
+
+        glProgramBinary(program, (GLenum)header.binaryFormat, binary.data(), (GLsizei)binary.size());
+
+        //a driver update with the same version string can still refuse it
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    bool ProgramCache::Store(uint64_t key, GLuint program) {
+
+        if (!enabled || !IsSupported())
+            return false;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+
+        std::vector<char> binary((size_t)length);
+        GLenum binaryFormat = 0;
+        glGetProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+
+        std::ofstream out(CachePath(key), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "WARNING: could not write program cache " << CachePath(key) << std::endl;
+            return false;
+        }
+
+        CacheHeader header;
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = CACHE_VERSION;
+        header.binaryFormat = binaryFormat;
+        header.key = key;
+        header.binaryLength = (uint64_t)length;
+
+        out.write((const char*)&header, sizeof(header));
+        out.write(binary.data(), length);
+        return (bool)out;
+    }
+}
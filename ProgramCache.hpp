@@ -0,0 +1,49 @@
+#ifndef ProgramCache_hpp
+#define ProgramCache_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    // Linked program binaries stored on disk, one file per program under
+    // shaders/cache. A program is found by a hash of its shader sources and
+    // of GL_RENDERER and GL_VERSION, so editing a shader or changing the GPU
+    // or driver simply misses the cache and the program is compiled again.
+    // Drivers may still reject a binary - Load then fails the same way.
+    class ProgramCache {
+
+    public:
+        // Set to false to always compile and link from source
+        static bool enabled;
+
+        static const char* const directory;
+
+        // True when the driver offers at least one binary format. macOS
+        // reports none. Queried once, on the thread owning the context.
+        static bool IsSupported();
+
+        // Key of the program built from these sources on this driver
+        static uint64_t Key(const std::string& vertexSource, const std::string& fragmentSource);
+
+        static std::string CachePath(uint64_t key);
+
+        // Replaces the program's code with the cached binary; false when it
+        // is missing, stale or rejected by the driver
+        static bool Load(uint64_t key, GLuint program);
+
+        // Saves a linked program - it must have been linked with
+        // GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+        static bool Store(uint64_t key, GLuint program);
+    };
+}
+
+#endif /* ProgramCache_hpp */
@@ -0,0 +1,303 @@
+#include "RenderQueue.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace gps {
+
+    namespace {
+
+        const char* const SAMPLER_NAMES[RenderQueue::textureUnits] = { "ambientTexture", "diffuseTexture", "specularTexture" };
+
+        //name of a GL object that is never bound - forces the first bind of each Execute
+        const GLuint UNKNOWN_STATE = ~0u - 1;
+    }
+
+    bool RenderQueue::multiDrawIndirect = true;
+    bool RenderQueue::multiDrawSupported = false;
+
+    RenderQueue::~RenderQueue() {
+
+        if (indirectBuffer != 0)
+            glDeleteBuffers(1, &indirectBuffer);
+    }
+
+    void RenderQueue::QueryMultiDrawSupport() {
+
+#if !defined (__APPLE__)
+        GLint versionMajor = 0, versionMinor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &versionMajor);
+        glGetIntegerv(GL_MINOR_VERSION, &versionMinor);
+        multiDrawSupported = versionMajor > 4 || (versionMajor == 4 && versionMinor >= 3);
+
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount; i++) {
+
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (strcmp(extension, "GL_ARB_multi_draw_indirect") == 0)
+                multiDrawSupported = true;
+        }
+#endif
+        //macOS stops at GL 4.1 and has no entry point for it
+    }
+
+    int RenderQueue::TextureUnit(const std::string& type) {
+
+        for (int unit = 0; unit < textureUnits; unit++)
+            if (type == SAMPLER_NAMES[unit])
+                return unit;
+        return -1;
+    }
+
+    void RenderQueue::Submit(gps::Shader& shader, GLuint vao, GLsizei indexCount, GLuint firstIndex, GLint baseVertex,
+                             const GLuint textures[textureUnits], const glm::mat4& model,
+                             const glm::vec3& boundsMin, const glm::vec3& boundsExtent, GLsizei instanceCount) {
+
+        DrawItem item;
+        item.shader = &shader;
+        item.vao = vao;
+        item.indexCount = indexCount;
+        item.firstIndex = firstIndex;
+        item.baseVertex = baseVertex;
+        item.instanceCount = instanceCount;
+        item.model = model;
+        item.boundsMin = boundsMin;
+        item.boundsExtent = boundsExtent;
+
+        //units the program never samples can keep whatever is bound
+        for (int unit = 0; unit < textureUnits; unit++)
+            item.textures[unit] = shader.getUniformLocation(SAMPLER_NAMES[unit]) >= 0 ? textures[unit] : anyTexture;
+
+        //program 8 bits | texture set 24 bits | VAO 16 bits | submission order 16 bits
+        item.key = ((uint64_t)(shader.shaderProgram & 0xFF) << 56) |
+            ((uint64_t)(TextureSetId(item.textures) & 0xFFFFFF) << 32) |
+            ((uint64_t)(vao & 0xFFFF) << 16) |
+            (uint64_t)(items.size() & 0xFFFF);
+
+        items.push_back(item);
+    }
+
+    uint32_t RenderQueue::TextureSetId(const GLuint textures[textureUnits]) {
+
+        //a fixed-size key, so looking up a known set allocates nothing
+        std::array<GLuint, textureUnits> textureSet;
+        std::copy(textures, textures + textureUnits, textureSet.begin());
+        auto found = textureSetIds.find(textureSet);
+        if (found != textureSetIds.end())
+            return found->second;
+
+        uint32_t id = (uint32_t)textureSetIds.size();
+        textureSetIds.emplace(textureSet, id);
+        return id;
+    }
+
+    bool RenderQueue::SameState(const DrawItem& a, const DrawItem& b) {
+
+        return a.shader == b.shader && a.vao == b.vao &&
+            memcmp(a.textures, b.textures, sizeof(a.textures)) == 0 &&
+            memcmp(&a.model, &b.model, sizeof(glm::mat4)) == 0 &&
+            a.boundsMin == b.boundsMin && a.boundsExtent == b.boundsExtent;
+    }
+
+    void RenderQueue::ConfigureSamplers(gps::Shader& shader) {
+
+        if (!configuredPrograms.insert(shader.shaderProgram).second)
+            return;
+
+        for (int unit = 0; unit < textureUnits; unit++)
+            glUniform1i(shader.getUniformLocation(SAMPLER_NAMES[unit]), unit);
+    }
+
+    void RenderQueue::Execute(const glm::mat4& view) {
+
+        order.resize(items.size());
+        for (uint32_t i = 0; i < (uint32_t)items.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return items[a].key < items[b].key;
+        });
+
+        //split the sorted items into runs that can share one multi-draw
+        bool multiDraw = multiDrawIndirect && multiDrawSupported;
+        commands.resize(order.size());
+        runLengths.clear();
+        bool merged = false;
+        for (size_t i = 0; i < order.size(); i++) {
+
+            const DrawItem& item = items[order[i]];
+            gps::DrawElementsIndirectCommand& command = commands[i];
+            command.count = (GLuint)item.indexCount;
+            command.instanceCount = item.instanceCount > 0 ? (GLuint)item.instanceCount : 1;
+            command.firstIndex = item.firstIndex;
+            command.baseVertex = item.baseVertex;
+            command.baseInstance = 0;
+
+            if (multiDraw && i > 0 && SameState(items[order[i - 1]], item)) {
+
+                runLengths.back()++;
+                merged = true;
+            }
+            else {
+                runLengths.push_back(1);
+            }
+        }
+
+        if (merged) {
+
+            if (indirectBuffer == 0)
+                glGenBuffers(1, &indirectBuffer);
+
+            size_t bytes = commands.size() * sizeof(gps::DrawElementsIndirectCommand);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            if (bytes > indirectCapacity)
+                indirectCapacity = bytes;
+            //orphan, the previous pass may still be reading its commands
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectCapacity, NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, bytes, commands.data());
+        }
+
+        //anything may have been bound since the last Execute
+        GLuint boundProgram = UNKNOWN_STATE;
+        GLuint boundVAO = UNKNOWN_STATE;
+        GLuint boundTextures[textureUnits];
+        for (int unit = 0; unit < textureUnits; unit++)
+            boundTextures[unit] = UNKNOWN_STATE;
+        GLint activeUnit = -1;
+
+        const DrawItem* previous = NULL;
+        GLint modelLoc = -1;
+        GLint normalMatrixLoc = -1;
+        GLint boundsMinLoc = -1;
+        GLint boundsExtentLoc = -1;
+
+        size_t first = 0;
+        for (uint32_t runLength : runLengths) {
+
+            //the first item of a run sets the state for all of it
+            const DrawItem& item = items[order[first]];
+            gps::Shader& shader = *item.shader;
+
+            if (shader.shaderProgram != boundProgram) {
+
+                shader.useShaderProgram();
+                ConfigureSamplers(shader);
+                boundProgram = shader.shaderProgram;
+                stats.programBinds++;
+
+                modelLoc = shader.getUniformLocation("model");
+                normalMatrixLoc = shader.getUniformLocation("normalMatrix");
+                boundsMinLoc = shader.getUniformLocation("meshBoundsMin");
+                boundsExtentLoc = shader.getUniformLocation("meshBoundsExtent");
+                previous = NULL;
+            }
+            else {
+                stats.programBindsAvoided++;
+            }
+
+            for (int unit = 0; unit < textureUnits; unit++) {
+
+                GLuint texture = item.textures[unit];
+                if (texture == anyTexture || texture == boundTextures[unit]) {
+
+                    stats.textureBindsAvoided++;
+                    continue;
+                }
+
+                if (activeUnit != unit) {
+
+                    glActiveTexture(GL_TEXTURE0 + unit);
+                    activeUnit = unit;
+                }
+                glBindTexture(GL_TEXTURE_2D, texture);
+                boundTextures[unit] = texture;
+                stats.textureBinds++;
+            }
+
+            if (item.vao != boundVAO) {
+
+                glBindVertexArray(item.vao);
+                boundVAO = item.vao;
+                stats.vaoBinds++;
+            }
+            else {
+                stats.vaoBindsAvoided++;
+            }
+
+            //transform and dequantization range, unless the previous item already set them
+            if (previous == NULL || memcmp(&previous->model, &item.model, sizeof(glm::mat4)) != 0) {
+
+                glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(item.model));
+                if (normalMatrixLoc >= 0) {
+
+                    glm::mat3 normalMatrix = glm::mat3(glm::inverseTranspose(view * item.model));
+                    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+                }
+                stats.uniformUpdates++;
+            }
+            else {
+                stats.uniformUpdatesAvoided++;
+            }
+
+            if (previous == NULL || previous->boundsMin != item.boundsMin || previous->boundsExtent != item.boundsExtent) {
+
+                glUniform3fv(boundsMinLoc, 1, glm::value_ptr(item.boundsMin));
+                glUniform3fv(boundsExtentLoc, 1, glm::value_ptr(item.boundsExtent));
+                stats.uniformUpdates++;
+            }
+            else {
+                stats.uniformUpdatesAvoided++;
+            }
+
+            //the rest of the run needed none of the above
+            stats.programBindsAvoided += runLength - 1;
+            stats.vaoBindsAvoided += runLength - 1;
+            stats.textureBindsAvoided += textureUnits * (runLength - 1);
+            stats.uniformUpdatesAvoided += 2 * (runLength - 1);
+
+            for (size_t i = first; i < first + runLength; i++)
+                stats.instances += commands[i].instanceCount;
+            stats.draws += runLength;
+
+            if (runLength > 1) {
+
+#if !defined (__APPLE__)
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                    (GLvoid*)(first * sizeof(gps::DrawElementsIndirectCommand)), (GLsizei)runLength, 0);
+#endif
+            }
+            else if (item.instanceCount > 0) {
+
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.indexCount, GL_UNSIGNED_INT,
+                    (GLvoid*)(item.firstIndex * sizeof(GLuint)), item.instanceCount, item.baseVertex);
+            }
+            else {
+
+                glDrawElementsBaseVertex(GL_TRIANGLES, item.indexCount, GL_UNSIGNED_INT,
+                    (GLvoid*)(item.firstIndex * sizeof(GLuint)), item.baseVertex);
+            }
+            stats.drawCalls++;
+
+            previous = &items[order[first + runLength - 1]];
+            first += runLength;
+        }
+
+        if (merged)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+        items.clear();
+    }
+
+    const gps::RenderStats& RenderQueue::GetStats() const {
+
+        return stats;
+    }
+
+    void RenderQueue::ResetStats() {
+
+        stats = gps::RenderStats();
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace gps {
+
+    // Per-frame counters; "avoided" is what drawing every item on its own
+    // (program, VAO, every texture unit and the transform) would have added
+    struct RenderStats {
+
+        unsigned draws;
+        // glDraw* calls issued - below draws when items were merged into multi-draws
+        unsigned drawCalls;
+        unsigned instances;
+        unsigned programBinds;
+        unsigned programBindsAvoided;
+        unsigned vaoBinds;
+        unsigned vaoBindsAvoided;
+        unsigned textureBinds;
+        unsigned textureBindsAvoided;
+        unsigned uniformUpdates;
+        unsigned uniformUpdatesAvoided;
+    };
+
+    // Layout of the commands read by glMultiDrawElementsIndirect
+    struct DrawElementsIndirectCommand {
+
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Collects draw items for one pass, sorts them by a packed 64-bit key
+    // (program | texture set | VAO | submission order) and issues them while
+    // a shadow copy of the bound GL state drops redundant binds.
+    // Material textures use fixed units: ambient 0, diffuse 1, specular 2.
+    // Consecutive items that only differ in their index range - meshes in the
+    // GeometryArena with the same material and transform - are issued as one
+    // glMultiDrawElementsIndirect when the context has it (GL 4.3), otherwise
+    // one base-vertex draw each.
+    class RenderQueue {
+
+    public:
+        static const int textureUnits = 3;
+        // texture slot value for samplers the program does not use
+        static const GLuint anyTexture = ~0u;
+
+        // Fixed unit for a material texture type, -1 if it has none
+        static int TextureUnit(const std::string& type);
+
+        // Detects glMultiDrawElementsIndirect support - call once on the GL thread
+        static void QueryMultiDrawSupport();
+
+        // Merge items into multi-draws when supported; cleared to force the per-draw path
+        static bool multiDrawIndirect;
+
+        ~RenderQueue();
+
+        // Indices are read from firstIndex on and offset by baseVertex.
+        // instanceCount > 0 draws with glDrawElementsInstanced; the transforms
+        // then come from the VAO's instance attributes instead of model
+        void Submit(gps::Shader& shader, GLuint vao, GLsizei indexCount, GLuint firstIndex, GLint baseVertex,
+                    const GLuint textures[textureUnits], const glm::mat4& model,
+                    const glm::vec3& boundsMin, const glm::vec3& boundsExtent, GLsizei instanceCount = 0);
+
+        // Draws and clears the queued items; view is used for normalMatrix
+        void Execute(const glm::mat4& view);
+
+        const gps::RenderStats& GetStats() const;
+        void ResetStats();
+
+    private:
+        struct DrawItem {
+
+            uint64_t key;
+            gps::Shader* shader;
+            GLuint vao;
+            GLsizei indexCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLsizei instanceCount;
+            GLuint textures[textureUnits];
+            glm::mat4 model;
+            glm::vec3 boundsMin;
+            glm::vec3 boundsExtent;
+        };
+
+        std::vector<DrawItem> items;
+        std::vector<uint32_t> order;
+        // one command per sorted item and the length of each run sharing all state
+        std::vector<gps::DrawElementsIndirectCommand> commands;
+        std::vector<uint32_t> runLengths;
+        GLuint indirectBuffer = 0;
+        size_t indirectCapacity = 0;
+        // small ids for texture sets, stable across frames
+        std::map<std::array<GLuint, textureUnits>, uint32_t> textureSetIds;
+        // programs whose sampler uniforms point at the fixed units
+        std::unordered_set<GLuint> configuredPrograms;
+
+        gps::RenderStats stats = {};
+
+        static bool multiDrawSupported;
+
+        uint32_t TextureSetId(const GLuint textures[textureUnits]);
+        // True when b can share a multi-draw with a - everything but the index range matches
+        static bool SameState(const DrawItem& a, const DrawItem& b);
+        void ConfigureSamplers(gps::Shader& shader);
+    };
+}
+
+#endif /* RenderQueue_hpp */
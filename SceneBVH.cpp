@@ -0,0 +1,173 @@
+#include "SceneBVH.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace gps {
+
+    MeshInstance::MeshInstance(gps::Mesh* mesh, const glm::mat4& model) : mesh(mesh), model(model) {
+
+        const gps::BoundingVolume& volume = mesh->getBoundingVolume();
+
+        //Arvo's method - the transformed box, boxed again along the world axes
+        glm::vec3 translation = glm::vec3(model[3]);
+        aabbMin = translation;
+        aabbMax = translation;
+        for (int column = 0; column < 3; column++) {
+            for (int row = 0; row < 3; row++) {
+
+                float a = model[column][row] * volume.aabbMin[column];
+                float b = model[column][row] * volume.aabbMax[column];
+                aabbMin[row] += std::min(a, b);
+                aabbMax[row] += std::max(a, b);
+            }
+        }
+
+        float scale = std::max(glm::length(glm::vec3(model[0])),
+            std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        sphereCenter = glm::vec3(model * glm::vec4(volume.sphereCenter, 1.0f));
+        sphereRadius = volume.sphereRadius * scale;
+    }
+
+    void SceneBVH::Build(std::vector<gps::MeshInstance> sceneInstances) {
+
+        instances = std::move(sceneInstances);
+        nodes.clear();
+        if (instances.empty())
+            return;
+
+        nodes.reserve(2 * instances.size());
+        nodes.resize(1);
+        BuildNode(0, 0, (uint32_t)instances.size());
+    }
+
+    void SceneBVH::BuildNode(uint32_t nodeIndex, uint32_t firstInstance, uint32_t instanceCount) {
+
+        glm::vec3 aabbMin = instances[firstInstance].aabbMin;
+        glm::vec3 aabbMax = instances[firstInstance].aabbMax;
+        glm::vec3 centroidMin = (aabbMin + aabbMax) * 0.5f;
+        glm::vec3 centroidMax = centroidMin;
+        for (uint32_t i = firstInstance; i < firstInstance + instanceCount; i++) {
+
+            aabbMin = glm::min(aabbMin, instances[i].aabbMin);
+            aabbMax = glm::max(aabbMax, instances[i].aabbMax);
+            glm::vec3 centroid = (instances[i].aabbMin + instances[i].aabbMax) * 0.5f;
+            centroidMin = glm::min(centroidMin, centroid);
+            centroidMax = glm::max(centroidMax, centroid);
+        }
+
+        nodes[nodeIndex].aabbMin = aabbMin;
+        nodes[nodeIndex].aabbMax = aabbMax;
+        nodes[nodeIndex].firstInstance = firstInstance;
+        nodes[nodeIndex].instanceCount = instanceCount;
+        nodes[nodeIndex].leftChild = 0;
+
+        if (instanceCount <= maxLeafSize)
+            return;
+
+        glm::vec3 spread = centroidMax - centroidMin;
+        int axis = 0;
+        if (spread.y > spread[axis])
+            axis = 1;
+        if (spread.z > spread[axis])
+            axis = 2;
+
+        uint32_t half = instanceCount / 2;
+        std::nth_element(instances.begin() + firstInstance, instances.begin() + firstInstance + half,
+            instances.begin() + firstInstance + instanceCount,
+            [axis](const gps::MeshInstance& a, const gps::MeshInstance& b) {
+                return a.aabbMin[axis] + a.aabbMax[axis] < b.aabbMin[axis] + b.aabbMax[axis];
+            });
+
+        uint32_t leftChild = (uint32_t)nodes.size();
+        nodes.resize(leftChild + 2);
+        nodes[nodeIndex].leftChild = leftChild;
+
+        BuildNode(leftChild, firstInstance, half);
+        BuildNode(leftChild + 1, firstInstance + half, instanceCount - half);
+    }
+
+    bool SceneBVH::IsVisible(const gps::Frustum& frustum, const gps::MeshInstance& instance) {
+
+        //the sphere rejects most meshes for a few dot products
+        return frustum.IntersectsSphere(instance.sphereCenter, instance.sphereRadius) &&
+            frustum.TestAABB(instance.aabbMin, instance.aabbMax) != FRUSTUM_OUTSIDE;
+    }
+
+    void SceneBVH::Cull(const gps::Frustum& frustum, std::vector<const gps::MeshInstance*>& visible, gps::CullStats& stats) const {
+
+        auto start = std::chrono::steady_clock::now();
+        size_t visibleBefore = visible.size();
+
+        uint32_t stack[64];
+        int stackSize = 0;
+        if (!nodes.empty())
+            stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+
+            const Node& node = nodes[stack[--stackSize]];
+            stats.nodesVisited++;
+
+            gps::FrustumTest test = frustum.TestAABB(node.aabbMin, node.aabbMax);
+            if (test == FRUSTUM_OUTSIDE)
+                continue;
+
+            if (test == FRUSTUM_INSIDE) {
+
+                for (uint32_t i = node.firstInstance; i < node.firstInstance + node.instanceCount; i++)
+                    visible.push_back(&instances[i]);
+                continue;
+            }
+
+            if (node.leftChild == 0) {
+
+                for (uint32_t i = node.firstInstance; i < node.firstInstance + node.instanceCount; i++)
+                    if (IsVisible(frustum, instances[i]))
+                        visible.push_back(&instances[i]);
+                continue;
+            }
+
+            //median splits keep the depth near log2(n), far below the stack size
+            stack[stackSize++] = node.leftChild + 1;
+            stack[stackSize++] = node.leftChild;
+        }
+
+        stats.visible += (unsigned)(visible.size() - visibleBefore);
+        stats.total += (unsigned)instances.size();
+        stats.cullTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void SceneBVH::CullInstances(const gps::Frustum& frustum, const std::vector<gps::MeshInstance>& instances,
+                                 std::vector<const gps::MeshInstance*>& visible, gps::CullStats& stats) {
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (const gps::MeshInstance& instance : instances) {
+
+            if (IsVisible(frustum, instance)) {
+
+                visible.push_back(&instance);
+                stats.visible++;
+            }
+        }
+
+        stats.total += (unsigned)instances.size();
+        stats.cullTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const std::vector<gps::MeshInstance>& SceneBVH::GetInstances() const {
+
+        return instances;
+    }
+
+    bool SceneBVH::GetBounds(glm::vec3& aabbMin, glm::vec3& aabbMax) const {
+
+        if (nodes.empty())
+            return false;
+
+        aabbMin = nodes[0].aabbMin;
+        aabbMax = nodes[0].aabbMax;
+        return true;
+    }
+}
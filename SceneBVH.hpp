@@ -0,0 +1,81 @@
+#ifndef SceneBVH_hpp
+#define SceneBVH_hpp
+
+#include <glm/glm.hpp>
+
+#include "Frustum.hpp"
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // A mesh placed in the world, with its bounds in world space
+    struct MeshInstance {
+
+        gps::Mesh* mesh;
+        glm::mat4 model;
+        glm::vec3 aabbMin;
+        glm::vec3 aabbMax;
+        glm::vec3 sphereCenter;
+        float sphereRadius;
+
+        MeshInstance(gps::Mesh* mesh, const glm::mat4& model);
+    };
+
+    // Per-frame culling counters - Cull adds to them
+    struct CullStats {
+
+        unsigned visible;
+        unsigned total;
+        unsigned nodesVisited;
+        double cullTime;
+    };
+
+    // Bounding volume hierarchy over mesh instances, split at the median
+    // centroid of the longest axis. Nodes fully inside the frustum accept
+    // their whole subtree without testing it; nodes partly inside test
+    // their children, and leaves test each instance's sphere then its AABB.
+    class SceneBVH {
+
+    public:
+        static const uint32_t maxLeafSize = 4;
+
+        // Rebuilds the tree - the instances are stored reordered
+        void Build(std::vector<gps::MeshInstance> instances);
+
+        // Appends the instances that may intersect the frustum to visible
+        void Cull(const gps::Frustum& frustum, std::vector<const gps::MeshInstance*>& visible, gps::CullStats& stats) const;
+
+        // Same test without a tree, for the few instances that move every frame
+        static void CullInstances(const gps::Frustum& frustum, const std::vector<gps::MeshInstance>& instances,
+                                  std::vector<const gps::MeshInstance*>& visible, gps::CullStats& stats);
+
+        const std::vector<gps::MeshInstance>& GetInstances() const;
+
+        // World-space box around every instance; false when the tree is empty
+        bool GetBounds(glm::vec3& aabbMin, glm::vec3& aabbMax) const;
+
+    private:
+        struct Node {
+
+            glm::vec3 aabbMin;
+            glm::vec3 aabbMax;
+            // instances of the whole subtree are contiguous
+            uint32_t firstInstance;
+            uint32_t instanceCount;
+            // children are leftChild and leftChild + 1; 0 for leaves
+            uint32_t leftChild;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<gps::MeshInstance> instances;
+
+        void BuildNode(uint32_t nodeIndex, uint32_t firstInstance, uint32_t instanceCount);
+
+        static bool IsVisible(const gps::Frustum& frustum, const gps::MeshInstance& instance);
+    };
+}
+
+#endif /* SceneBVH_hpp */
@@ -7,8 +7,35 @@
 //
 
 #include "Shader.hpp"
+#include "ProgramCache.hpp"
+
+#include <chrono>
 
 namespace gps {
+
+    namespace {
+
+        //by bit of ShaderFeature
+        const char* const FEATURE_DEFINES[] = { "HAS_SPECULAR_MAP", "SHADOWS", "POINT_LIGHTS", "FOG" };
+
+        std::string injectDefines(const std::string& source, uint32_t features) {
+
+            //#version has to stay the first line
+            size_t lineEnd = source.find('\n');
+            if (lineEnd == std::string::npos)
+                return source;
+
+            std::string defines;
+            for (uint32_t bit = 0; bit < sizeof(FEATURE_DEFINES) / sizeof(FEATURE_DEFINES[0]); bit++)
+                if (features & (1u << bit))
+                    defines += std::string("#define ") + FEATURE_DEFINES[bit] + "\n";
+            //compile errors keep the line numbers of the file
+            defines += "#line 2\n";
+
+            return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+        }
+    }
+
     std::string Shader::readShaderFile(std::string fileName) {
 
         std::ifstream shaderFile;
@@ -45,7 +72,7 @@ namespace gps {
         }
     }
     
-    void Shader::shaderLinkLog(GLuint shaderProgramId) {
+    bool Shader::shaderLinkLog(GLuint shaderProgramId) {
 
         GLint success;
         GLchar infoLog[512];
@@ -56,41 +83,246 @@ namespace gps {
             glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
             std::cout << "Shader linking error\n" << infoLog << std::endl;
         }
+        return success == GL_TRUE;
     }
     
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName) {
 
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
+        submitShader(vertexShaderFileName, fragmentShaderFileName);
+        finishProgram();
+    }
+
+    void Shader::loadPermutations(std::string vertexShaderFileName, std::string fragmentShaderFileName, uint32_t permutationFeatures) {
+
+        submitShader(vertexShaderFileName, fragmentShaderFileName, permutationFeatures);
+        finishProgram();
+    }
+
+    void Shader::submitShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, uint32_t permutationFeatures) {
+
+        this->permutationFeatures = permutationFeatures;
+        this->features = permutationFeatures;
+        this->ownedVariants.clear();
+        this->compiledVariants.assign(1, this);
+        this->variants.clear();
+
+        if (permutationFeatures == 0) {
+
+            beginProgram(readShaderFile(vertexShaderFileName), readShaderFile(fragmentShaderFileName));
+            return;
+        }
+
+        this->vertexSource = readShaderFile(vertexShaderFileName);
+        this->fragmentSource = readShaderFile(fragmentShaderFileName);
+        this->variants[permutationFeatures] = this;
+        beginProgram(injectDefines(this->vertexSource, permutationFeatures), injectDefines(this->fragmentSource, permutationFeatures));
+    }
+
+    void Shader::setFeatures(uint32_t features) {
+
+        this->features = features;
+    }
+
+    gps::Shader& Shader::getVariant(uint32_t materialFeatures) {
+
+        if (this->permutationFeatures == 0)
+            return *this;
+
+        uint32_t key = this->permutationFeatures & this->features & (materialFeatures | ~materialFeatureMask);
+        auto found = this->variants.find(key);
+        if (found != this->variants.end())
+            return *found->second;
+
+        //first use of a combination that was not submitted up front - compiled while drawing
+        gps::Shader& variant = *submitVariant(key);
+        variant.finishProgram();
+
+        for (const std::pair<std::string, GLuint>& binding : this->uniformBlockBindings)
+            variant.bindUniformBlock(binding.first.c_str(), binding.second);
+        if (this->variantSetup) {
+
+            variant.useShaderProgram();
+            this->variantSetup(variant);
+        }
+
+        return variant;
+    }
+
+    gps::Shader* Shader::submitVariant(uint32_t features) {
+
+        uint32_t key = this->permutationFeatures & features;
+        if (this->permutationFeatures == 0 || this->variants.count(key) != 0)
+            return NULL;
+
+        this->ownedVariants.emplace_back(new gps::Shader());
+        gps::Shader& variant = *this->ownedVariants.back();
+        variant.compiledVariants.assign(1, &variant);
+        variant.beginProgram(injectDefines(this->vertexSource, key), injectDefines(this->fragmentSource, key));
+
+        this->variants[key] = &variant;
+        this->compiledVariants.push_back(&variant);
+        return &variant;
+    }
+
+    uint32_t Shader::getPermutationFeatures() const {
+
+        return this->permutationFeatures;
+    }
+
+    const std::vector<gps::Shader*>& Shader::getVariants() const {
+
+        return this->compiledVariants;
+    }
+
+    void Shader::setVariantSetup(std::function<void(gps::Shader&)> setup) {
+
+        this->variantSetup = setup;
+        for (gps::Shader* variant : this->compiledVariants) {
+
+            variant->useShaderProgram();
+            setup(*variant);
+        }
+    }
+
+    void Shader::beginProgram(const std::string& v, const std::string& f) {
+
+        this->buildStart = std::chrono::steady_clock::now();
+
+        //a binary linked from the same sources on the same driver skips compiling
+        this->shaderProgram = glCreateProgram();
+        this->pendingCacheKey = 0;
+        this->fromBinaryCache = false;
+        if (gps::ProgramCache::enabled && gps::ProgramCache::IsSupported()) {
+
+            this->pendingCacheKey = gps::ProgramCache::Key(v, f);
+            this->fromBinaryCache = gps::ProgramCache::Load(this->pendingCacheKey, this->shaderProgram);
+        }
+
+        if (this->fromBinaryCache)
+            return;
+
+        //parse and compile the vertex shader
         const GLchar* vertexShaderString = v.c_str();
         GLuint vertexShader;
         vertexShader = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
         glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
         
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
+        //parse and compile the fragment shader
         const GLchar* fragmentShaderString = f.c_str();
         GLuint fragmentShader;
         fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
         glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
         
-        //attach and link the shader programs
-        this->shaderProgram = glCreateProgram();
+        //attach and link the shader programs; any status query would wait for the driver
         glAttachShader(this->shaderProgram, vertexShader);
         glAttachShader(this->shaderProgram, fragmentShader);
+        if (this->pendingCacheKey != 0)
+            glProgramParameteri(this->shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(this->shaderProgram);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        //check linking info
-        shaderLinkLog(this->shaderProgram);
+
+        this->pendingShaders[0] = vertexShader;
+        this->pendingShaders[1] = fragmentShader;
+    }
+
+    void Shader::finishProgram() {
+
+        if (!this->fromBinaryCache) {
+
+            //check compilation status
+            shaderCompileLog(this->pendingShaders[0]);
+            shaderCompileLog(this->pendingShaders[1]);
+
+            for (GLuint shader : this->pendingShaders) {
+
+                glDetachShader(this->shaderProgram, shader);
+                glDeleteShader(shader);
+            }
+            this->pendingShaders[0] = this->pendingShaders[1] = 0;
+
+            //check linking info
+            if (shaderLinkLog(this->shaderProgram) && this->pendingCacheKey != 0)
+                gps::ProgramCache::Store(this->pendingCacheKey, this->shaderProgram);
+        }
+
+        reflectUniforms();
+
+        this->loadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->buildStart).count();
+    }
+
+    uint64_t Shader::hashUniformName(const char* name) {
+
+        //FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for (; *name; name++) {
+            hash ^= (unsigned char)*name;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    void Shader::reflectUniforms() {
+
+        uniformLocations.clear();
+
+        GLint uniformCount = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+        std::string name(maxNameLength > 0 ? maxNameLength : 1, '\0');
+        for (GLint i = 0; i < uniformCount; i++) {
+
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+
+            //uniform block members have no location
+            GLint location = glGetUniformLocation(this->shaderProgram, name.c_str());
+            if (location < 0)
+                continue;
+
+            std::string uniformName(name.c_str(), length);
+            uniformLocations[hashUniformName(uniformName.c_str())] = location;
+
+            //arrays are reported as "name[0]" but also looked up as "name"
+            size_t bracket = uniformName.find('[');
+            if (bracket != std::string::npos)
+                uniformLocations[hashUniformName(uniformName.substr(0, bracket).c_str())] = location;
+        }
+    }
+
+    GLint Shader::getUniformLocation(const char* name) const {
+
+        auto found = uniformLocations.find(hashUniformName(name));
+        return found != uniformLocations.end() ? found->second : -1;
+    }
+
+    void Shader::bindUniformBlock(const char* blockName, GLuint binding) {
+
+        if (this->permutationFeatures != 0)
+            this->uniformBlockBindings.emplace_back(blockName, binding);
+
+        for (gps::Shader* variant : this->compiledVariants) {
+
+            GLuint blockIndex = glGetUniformBlockIndex(variant->shaderProgram, blockName);
+            if (blockIndex != GL_INVALID_INDEX)
+                glUniformBlockBinding(variant->shaderProgram, blockIndex, binding);
+        }
     }
     
+    double Shader::getLoadTime() const {
+
+        return this->loadTime;
+    }
+
+    bool Shader::isFromBinaryCache() const {
+
+        return this->fromBinaryCache;
+    }
+
     void Shader::useShaderProgram() {
 
         glUseProgram(this->shaderProgram);
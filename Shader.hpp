@@ -17,24 +17,120 @@
     #include <GL/glew.h>
 #endif
 
+#include <chrono>
+#include <cstdint>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 
 namespace gps {
+
+    // Compile-time features of a permutation program, each defined in a
+    // variant's sources by its name without the SHADER_ prefix
+    enum ShaderFeature : uint32_t {
+        SHADER_HAS_SPECULAR_MAP = 1u << 0,
+        SHADER_SHADOWS = 1u << 1,
+        SHADER_POINT_LIGHTS = 1u << 2,
+        SHADER_FOG = 1u << 3
+    };
     
     class Shader {
 
     public:
+        // features that depend on the material rather than the frame
+        static const uint32_t materialFeatureMask = SHADER_HAS_SPECULAR_MAP;
+
         GLuint shaderProgram;
         void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
         void useShaderProgram();
+
+        // Loads a program with one variant per combination of permutationFeatures,
+        // each compiled the first time getVariant asks for it unless submitted
+        // before. The program itself is the variant with all of them.
+        void loadPermutations(std::string vertexShaderFileName, std::string fragmentShaderFileName, uint32_t permutationFeatures);
+
+        // As loadShader, or loadPermutations with permutationFeatures, without
+        // waiting for the driver: the compile and link are only submitted and
+        // finishProgram checks them. See ShaderManager.
+        void submitShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, uint32_t permutationFeatures = 0);
+
+        // Checks the submitted compile and link - blocking until the driver is
+        // done - and builds the uniform table
+        void finishProgram();
+
+        // Features the frame state allows from now on, all of them after loadPermutations
+        void setFeatures(uint32_t features);
+
+        // The variant with the allowed features, less the material features
+        // missing from materialFeatures. Shaders loaded with loadShader are
+        // their only variant.
+        gps::Shader& getVariant(uint32_t materialFeatures);
+
+        // Submits the variant with features without waiting for the driver;
+        // finishProgram on the returned shader checks it. NULL when the
+        // variant already exists or the program has no permutations.
+        gps::Shader* submitVariant(uint32_t features);
+
+        uint32_t getPermutationFeatures() const;
+
+        // Variants compiled or submitted so far, for uniforms that have to reach all of them
+        const std::vector<gps::Shader*>& getVariants() const;
+
+        // Called now on every variant so far and on every one compiled from
+        // now on, with its program in use
+        void setVariantSetup(std::function<void(gps::Shader&)> setup);
+
+        // Location of an active uniform, from the table built at link time.
+        // Returns -1 (ignored by glUniform*) for names the program does not use.
+        GLint getUniformLocation(const char* name) const;
+
+        // Attaches a uniform block of the program - and of all its variants,
+        // present and future - to a buffer binding point
+        void bindUniformBlock(const char* blockName, GLuint binding);
+
+        // Milliseconds from submitting the program to finishProgram - or to
+        // loading it from the ProgramCache
+        double getLoadTime() const;
+        bool isFromBinaryCache() const;
     
     private:
+        double loadTime = 0.0;
+        bool fromBinaryCache = false;
+
+        // between beginProgram and finishProgram
+        std::chrono::steady_clock::time_point buildStart;
+        GLuint pendingShaders[2] = { 0, 0 };
+        uint64_t pendingCacheKey = 0;
+
+        // sources with no defines and the variants built from them
+        std::string vertexSource;
+        std::string fragmentSource;
+        uint32_t permutationFeatures = 0;
+        uint32_t features = 0;
+        std::unordered_map<uint32_t, gps::Shader*> variants;
+        std::vector<gps::Shader*> compiledVariants;
+        std::vector<std::unique_ptr<gps::Shader>> ownedVariants;
+        std::vector<std::pair<std::string, GLuint>> uniformBlockBindings;
+        std::function<void(gps::Shader&)> variantSetup;
+
+        // active uniform locations keyed by name hash
+        std::unordered_map<uint64_t, GLint> uniformLocations;
+
+        static uint64_t hashUniformName(const char* name);
+        void reflectUniforms();
+
         std::string readShaderFile(std::string fileName);
+        // Creates shaderProgram from the sources through the ProgramCache, or
+        // submits their compile and link without querying any status
+        void beginProgram(const std::string& v, const std::string& f);
         void shaderCompileLog(GLuint shaderId);
-        void shaderLinkLog(GLuint shaderProgramId);
+        // Returns the link status
+        bool shaderLinkLog(GLuint shaderProgramId);
     };
     
 }
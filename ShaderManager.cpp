@@ -0,0 +1,181 @@
+#include "ShaderManager.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace gps {
+
+    namespace {
+
+        enum { NOT_QUERIED, UNSUPPORTED, KHR_EXTENSION, ARB_EXTENSION };
+
+        int parallelCompile = NOT_QUERIED;
+
+        double millisecondsSince(std::chrono::steady_clock::time_point start) {
+
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    bool ShaderManager::parallel = true;
+
+    bool ShaderManager::IsParallelCompileSupported() {
+
+        if (parallelCompile != NOT_QUERIED)
+            return parallelCompile != UNSUPPORTED;
+
+        parallelCompile = UNSUPPORTED;
+#if !defined (__APPLE__)
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount; i++) {
+
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0)
+                parallelCompile = KHR_EXTENSION;
+            else if (strcmp(extension, "GL_ARB_parallel_shader_compile") == 0 && parallelCompile == UNSUPPORTED)
+                parallelCompile = ARB_EXTENSION;
+        }
+
+        //0xFFFFFFFF lets the driver pick the thread count
+        if (parallelCompile == KHR_EXTENSION)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if (parallelCompile == ARB_EXTENSION)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+#endif
+        //macOS compiles on the calling thread
+        return parallelCompile != UNSUPPORTED;
+    }
+
+    void ShaderManager::Add(gps::Shader& shader, const char* vertexShaderFileName, const char* fragmentShaderFileName,
+                            uint32_t permutationFeatures) {
+
+        auto start = BeginSubmit();
+        shader.submitShader(vertexShaderFileName, fragmentShaderFileName, permutationFeatures);
+        EndSubmit(shader, start);
+    }
+
+    void ShaderManager::AddVariants(gps::Shader& shader) {
+
+        //every subset of the permutation features, down to none
+        uint32_t permutationFeatures = shader.getPermutationFeatures();
+        uint32_t features = permutationFeatures;
+        do {
+
+            auto start = BeginSubmit();
+            gps::Shader* variant = shader.submitVariant(features);
+            if (variant)
+                EndSubmit(*variant, start);
+            features = (features - 1) & permutationFeatures;
+        } while (features != permutationFeatures);
+    }
+
+    std::chrono::steady_clock::time_point ShaderManager::BeginSubmit() {
+
+        auto start = std::chrono::steady_clock::now();
+        if (added == 0)
+            firstSubmit = start;
+        if (parallel)
+            IsParallelCompileSupported();
+        return start;
+    }
+
+    void ShaderManager::EndSubmit(gps::Shader& shader, std::chrono::steady_clock::time_point start) {
+
+        added++;
+        stats.programs++;
+        stats.submitTime += millisecondsSince(start);
+        lastSubmitTime = millisecondsSince(firstSubmit);
+
+        if (parallel)
+            pending.push_back(&shader);
+        else
+            FinishProgram(shader);
+    }
+
+    void ShaderManager::FinishProgram(gps::Shader& shader) {
+
+        auto start = std::chrono::steady_clock::now();
+        shader.finishProgram();
+        if (shader.isFromBinaryCache())
+            stats.cached++;
+        stats.finishTime += millisecondsSince(start);
+        stats.wallTime = millisecondsSince(firstSubmit);
+        UpdateOverlap();
+    }
+
+    void ShaderManager::BeginWaiting() {
+
+        if (waitStartTime < 0.0)
+            waitStartTime = millisecondsSince(firstSubmit);
+        UpdateOverlap();
+    }
+
+    void ShaderManager::UpdateOverlap() {
+
+        //serial programs finish inside Add and overlap nothing
+        double end = waitStartTime < 0.0 ? stats.wallTime : std::min(waitStartTime, stats.wallTime);
+        stats.overlapTime = std::max(0.0, end - lastSubmitTime);
+    }
+
+    bool ShaderManager::Update() {
+
+        BeginWaiting();
+        if (pending.empty())
+            return true;
+
+        if (!IsParallelCompileSupported()) {
+
+            FinishProgram(*pending.front());
+            pending.erase(pending.begin());
+            return pending.empty();
+        }
+        return FinishCompleted();
+    }
+
+    bool ShaderManager::Poll() {
+
+        if (pending.empty())
+            return true;
+        if (!IsParallelCompileSupported())
+            return false;
+        return FinishCompleted();
+    }
+
+    bool ShaderManager::FinishCompleted() {
+
+        //GL_COMPLETION_STATUS_KHR is the only query that does not wait for the driver
+        size_t kept = 0;
+        for (gps::Shader* shader : pending) {
+
+            GLint completed = GL_TRUE;
+#if !defined (__APPLE__)
+            glGetProgramiv(shader->shaderProgram, GL_COMPLETION_STATUS_KHR, &completed);
+#endif
+            if (completed)
+                FinishProgram(*shader);
+            else
+                pending[kept++] = shader;
+        }
+        pending.resize(kept);
+        return pending.empty();
+    }
+
+    void ShaderManager::Finish() {
+
+        BeginWaiting();
+        for (gps::Shader* shader : pending)
+            FinishProgram(*shader);
+        pending.clear();
+    }
+
+    float ShaderManager::GetProgress() const {
+
+        return added > 0 ? (float)(added - pending.size()) / added : 1.0f;
+    }
+
+    const gps::ShaderLoadStats& ShaderManager::GetStats() const {
+
+        return stats;
+    }
+}
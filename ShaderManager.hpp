@@ -0,0 +1,98 @@
+#ifndef ShaderManager_hpp
+#define ShaderManager_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Shader.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Startup timings of the programs of a ShaderManager
+    struct ShaderLoadStats {
+
+        unsigned programs;
+        unsigned cached;
+        // main thread milliseconds spent submitting and finishing programs
+        double submitTime;
+        double finishTime;
+        // from the first submission until the last program was seen complete -
+        // compile wall time when Poll ran often enough in between
+        double wallTime;
+        // part of wallTime after the last submission and before the first
+        // Update or Finish - the app was doing other work meanwhile
+        double overlapTime;
+    };
+
+    // Builds the startup programs without stalling on each one: every
+    // compile and link is submitted before any status is queried, so the
+    // driver can work on all of them - on its own threads with
+    // GL_KHR_parallel_shader_compile - while the app draws a loading screen.
+    class ShaderManager {
+
+    public:
+        // Cleared, each program is compiled and checked before the next is
+        // submitted, as Shader::loadShader does
+        static bool parallel;
+
+        // Asks for the driver's compiler threads if it has the extension; once
+        static bool IsParallelCompileSupported();
+
+        // Submits the program; loadPermutations when permutationFeatures is not 0
+        void Add(gps::Shader& shader, const char* vertexShaderFileName, const char* fragmentShaderFileName,
+                 uint32_t permutationFeatures = 0);
+
+        // Submits every other variant of a program added with permutations, so
+        // none of them is compiled in the middle of a frame
+        void AddVariants(gps::Shader& shader);
+
+        // Finishes the programs the driver is done with and returns true once all
+        // are. Without the extension every query blocks, so one program a call.
+        bool Update();
+
+        // As Update, but never blocks: without the extension it finishes nothing.
+        // For loops that have other work, so completion is seen when it happens.
+        bool Poll();
+
+        // Finishes every program, blocking
+        void Finish();
+
+        // Fraction of the programs finished
+        float GetProgress() const;
+
+        const gps::ShaderLoadStats& GetStats() const;
+
+    private:
+        std::vector<gps::Shader*> pending;
+        size_t added = 0;
+        gps::ShaderLoadStats stats = {};
+        std::chrono::steady_clock::time_point firstSubmit;
+        // milliseconds after firstSubmit
+        double lastSubmitTime = 0.0;
+        double waitStartTime = -1.0;
+
+        // Notes the first submission; returns the time the submission starts
+        std::chrono::steady_clock::time_point BeginSubmit();
+        void EndSubmit(gps::Shader& shader, std::chrono::steady_clock::time_point start);
+
+        void FinishProgram(gps::Shader& shader);
+
+        // Finishes the programs whose GL_COMPLETION_STATUS_KHR reads true
+        bool FinishCompleted();
+
+        // Ends overlapTime on the first blocking call
+        void BeginWaiting();
+        void UpdateOverlap();
+    };
+}
+
+#endif /* ShaderManager_hpp */
@@ -21,20 +21,15 @@ namespace gps {
         InitSkyBox();
     }
     
-    void SkyBox::Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+    void SkyBox::Draw(gps::Shader& shader)
     {
         shader.useShaderProgram();
         
-        //set the view and projection matrices
-        glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
-        
         glDepthFunc(GL_LEQUAL);
         
         glBindVertexArray(skyboxVAO);
         glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
+        glUniform1i(shader.getUniformLocation("skybox"), 0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
         glBindVertexArray(0);
@@ -55,6 +50,19 @@ namespace gps {
         glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
         for(GLuint i = 0; i < skyBoxFaces.size(); i++)
         {
+            //cooked block-compressed face from texcook, if any
+            gps::Ktx2Image cooked;
+            if (gps::TextureCache::LoadCooked(skyBoxFaces[i], cooked))
+            {
+                const gps::Ktx2Level& level = cooked.levels[0];
+                glCompressedTexImage2D(
+                                       GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
+                                       gps::TextureCache::CompressedFormat(cooked.format), level.width, level.height, 0,
+                                       (GLsizei)level.data.size(), level.data.data()
+                                       );
+                continue;
+            }
+            
             image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
             if (!image) {
                 fprintf(stderr, "ERROR: could not load %s\n", skyBoxFaces[i]);
@@ -0,0 +1,534 @@
+#include "TextureCache.hpp"
+#include "ImageUtil.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+namespace gps {
+
+    namespace {
+
+        bool readFile(const std::string& path, std::vector<unsigned char>& contents) {
+
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            if (!in)
+                return false;
+
+            contents.resize((size_t)in.tellg());
+            in.seekg(0);
+            return (bool)in.read((char*)contents.data(), contents.size());
+        }
+
+        // 64-bit FNV-1a over 8-byte words, seeded with the size
+        uint64_t hashContents(const std::vector<unsigned char>& contents) {
+
+            const uint64_t prime = 1099511628211ull;
+            uint64_t hash = 14695981039346656037ull ^ (uint64_t)contents.size();
+
+            size_t i = 0;
+            for (; i + 8 <= contents.size(); i += 8) {
+
+                uint64_t word;
+                memcpy(&word, contents.data() + i, sizeof(word));
+                hash = (hash ^ word) * prime;
+                hash ^= hash >> 29;
+            }
+            for (; i < contents.size(); i++)
+                hash = (hash ^ contents[i]) * prime;
+
+            return hash;
+        }
+
+        // One mip level of a decoded or cooked image. Levels are staged in
+        // units of rowBytes: a pixel row, or a row of 4x4 blocks when compressed.
+        struct MipLevel {
+
+            const unsigned char* data;
+            size_t offset;      // in the pixel buffer, where the levels lie back to back
+            size_t size;
+            int width;
+            int height;
+            size_t rowBytes;
+            size_t units;
+            int unitRows;
+        };
+
+        int levelCount(const gps::ImageData& image) {
+
+            if (image.compressed)
+                return (int)image.compressed->levels.size();
+            return 1 + (image.mipmaps ? (int)image.mipmaps->size() : 0);
+        }
+
+        MipLevel mipLevel(const gps::ImageData& image, int level) {
+
+            MipLevel mip;
+            mip.offset = 0;
+            for (int i = 0; i <= level; i++) {
+
+                if (image.compressed) {
+
+                    const gps::Ktx2Level& current = image.compressed->levels[i];
+                    mip.data = current.data.data();
+                    mip.size = current.data.size();
+                    mip.width = (int)current.width;
+                    mip.height = (int)current.height;
+                    mip.unitRows = 4;
+                }
+                else {
+
+                    mip.data = i == 0 ? image.pixels : (*image.mipmaps)[i - 1].data();
+                    mip.width = std::max(1, image.width >> i);
+                    mip.height = std::max(1, image.height >> i);
+                    mip.size = (size_t)mip.width * mip.height * 4;
+                    mip.unitRows = 1;
+                }
+                if (i < level)
+                    mip.offset += mip.size;
+            }
+
+            mip.units = (size_t)(mip.height + mip.unitRows - 1) / mip.unitRows;
+            mip.rowBytes = mip.size / mip.units;
+            return mip;
+        }
+    }
+
+    size_t TextureCache::uploadBudget = 4 * 1024 * 1024;
+    bool TextureCache::s3tcSupported = false;
+    bool TextureCache::etc2Supported = false;
+
+    TextureCache::TextureCache() : decodePool(0) {
+    }
+
+    TextureCache& TextureCache::Instance() {
+
+        static TextureCache instance;
+        return instance;
+    }
+
+    void TextureCache::RequestDecode(const std::string& path) {
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pathKeys.count(path) != 0)
+                return;
+        }
+
+        auto contents = std::make_shared<std::vector<unsigned char>>();
+        if (!readFile(path, *contents)) {
+            fprintf(stderr, "ERROR: could not read %s\n", path.c_str());
+            return;
+        }
+
+        //an entry is only shared by identical files: a different file with the
+        //same hash moves on to the next key
+        uint64_t key = hashContents(*contents);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+
+            if (pathKeys.count(path) != 0)
+                return;
+
+            auto found = entries.find(key);
+            if (found == entries.end())
+                break;
+
+            if (found->second.fileSize != contents->size()) {
+
+                key++;
+                continue;
+            }
+
+            //same size - compare the bytes without holding the lock
+            std::string entryPath = found->second.path;
+            lock.unlock();
+            std::vector<unsigned char> entryContents;
+            bool same = readFile(entryPath, entryContents) && entryContents == *contents;
+            lock.lock();
+
+            found = entries.find(key);
+            if (found == entries.end() || found->second.path != entryPath)
+                continue;
+
+            if (same) {
+
+                //same image under another path, already loaded or being decoded
+                pathKeys[path] = key;
+                return;
+            }
+            key++;
+        }
+
+        pathKeys[path] = key;
+        Entry& entry = entries[key];
+        entry.id = 0;
+        entry.refCount = 0;
+        entry.path = path;
+        entry.fileSize = contents->size();
+        entry.decoded = decodePool.Submit([path, contents]() {
+
+            //prefer the block-compressed file from texcook
+            auto cooked = std::make_shared<gps::Ktx2Image>();
+            if (LoadCooked(path, *cooked)) {
+
+                gps::ImageData image;
+                image.width = (int)cooked->levels[0].width;
+                image.height = (int)cooked->levels[0].height;
+                image.pixels = NULL;
+                image.compressed = cooked;
+                return image;
+            }
+            return DecodeImage(path.c_str(), contents->data(), contents->size());
+        }).share();
+    }
+
+    GLuint TextureCache::Acquire(const std::string& path) {
+
+        RequestDecode(path);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto known = pathKeys.find(path);
+        if (known == pathKeys.end())
+            return 0;
+
+        auto found = entries.find(known->second);
+        if (found == entries.end())
+            return 0;
+
+        Entry& entry = found->second;
+        if (entry.id != 0) {
+
+            //already acquired by this or another model
+            entry.refCount++;
+            return entry.id;
+        }
+
+        //render with a placeholder until the decoded image is streamed in
+        entry.id = CreatePlaceholder();
+        entry.refCount = 1;
+        textureKeys[entry.id] = known->second;
+
+        Upload upload;
+        upload.key = known->second;
+        upload.id = entry.id;
+        upload.path = path;
+        upload.decoded = entry.decoded;
+        upload.pixelBuffer = 0;
+        upload.level = -1;
+        upload.copied = 0;
+        upload.frames = 0;
+        uploads.push_back(upload);
+
+        entry.decoded = std::shared_future<gps::ImageData>();
+
+        return entry.id;
+    }
+
+    void TextureCache::Release(GLuint textureId) {
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto found = textureKeys.find(textureId);
+        if (found == textureKeys.end())
+            return;
+
+        Entry& entry = entries[found->second];
+        if (--entry.refCount > 0)
+            return;
+
+        //a pending upload notices the missing entry and drops its pixels
+        glDeleteTextures(1, &textureId);
+        for (auto known = pathKeys.begin(); known != pathKeys.end(); ) {
+
+            if (known->second == found->second)
+                known = pathKeys.erase(known);
+            else
+                ++known;
+        }
+        entries.erase(found->second);
+        textureKeys.erase(found);
+    }
+
+    void TextureCache::Update() {
+
+        size_t budget = uploadBudget > 0 ? uploadBudget : SIZE_MAX;
+
+        for (size_t i = 0; i < uploads.size() && budget > 0; ) {
+
+            Upload& upload = uploads[i];
+            upload.frames++;
+
+            if (upload.decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+
+                i++;
+                continue;
+            }
+
+            if (StreamUpload(upload, budget)) {
+
+                uploads.erase(uploads.begin() + i);
+                continue;
+            }
+            i++;
+        }
+    }
+
+    size_t TextureCache::PendingUploads() const {
+
+        std::lock_guard<std::mutex> lock(mutex);
+        return uploads.size();
+    }
+
+    GLuint TextureCache::CreatePlaceholder() {
+
+        const unsigned char grey[4] = { 128, 128, 128, 255 };
+
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        return textureID;
+    }
+
+    bool TextureCache::StreamUpload(Upload& upload, size_t& budget) {
+
+        const gps::ImageData& image = upload.decoded.get();
+
+        bool released;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = entries.find(upload.key);
+            released = found == entries.end() || found->second.id != upload.id;
+        }
+
+        if (released || (!image.pixels && !image.compressed)) {
+
+            //texture released while loading, or the decode failed
+            if (upload.pixelBuffer)
+                glDeleteBuffers(1, &upload.pixelBuffer);
+            stbi_image_free(image.pixels);
+            return true;
+        }
+
+        GLenum format = image.compressed ? CompressedFormat(image.compressed->format) : 0;
+        glBindTexture(GL_TEXTURE_2D, upload.id);
+
+        if (upload.level < 0) {
+
+            //allocate every level without data - no pixel buffer may be bound here
+            int levels = levelCount(image);
+            size_t size = 0;
+            for (int level = 0; level < levels; level++) {
+
+                MipLevel mip = mipLevel(image, level);
+                if (image.compressed)
+                    glCompressedTexImage2D(GL_TEXTURE_2D, level, format, mip.width, mip.height, 0, (GLsizei)mip.size, NULL);
+                else
+                    glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                size += mip.size;
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+            glGenBuffers(1, &upload.pixelBuffer);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pixelBuffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+            upload.level = levels - 1;
+            upload.copied = 0;
+        }
+        else {
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pixelBuffer);
+        }
+
+        //smallest level first, at least one band per call so the 1x1 level
+        //replaces the placeholder in the frame the storage is allocated
+        do {
+
+            MipLevel mip = mipLevel(image, upload.level);
+            size_t first = upload.copied / mip.rowBytes;
+            size_t units = std::min(std::max<size_t>(1, budget / mip.rowBytes), mip.units - first);
+            size_t bytes = units * mip.rowBytes;
+            size_t offset = mip.offset + upload.copied;
+
+            //every range is written once, so there is nothing to synchronize with
+            unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, bytes,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+            //the map fails when the driver is out of memory - then the band goes from client memory
+            std::vector<unsigned char> staging;
+            if (!mapped) {
+
+                staging.resize(bytes);
+                mapped = staging.data();
+            }
+
+            if (image.compressed) {
+
+                memcpy(mapped, mip.data + upload.copied, bytes);
+            }
+            else {
+
+                //flip rows while staging - the band holds the matching file rows counted from the bottom
+                gps::CopyRowsFlipped(mapped, mip.data + (mip.units - first - units) * mip.rowBytes, mip.rowBytes,
+                    units, 0, bytes);
+            }
+
+            const GLvoid* source = (GLvoid*)offset;
+            if (staging.empty()) {
+
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+            else {
+
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                source = staging.data();
+            }
+
+            GLint y = (GLint)first * mip.unitRows;
+            GLsizei height = std::min(mip.height - y, (GLsizei)units * mip.unitRows);
+            if (image.compressed)
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, y, mip.width, height, format,
+                    (GLsizei)bytes, source);
+            else
+                glTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, y, mip.width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                    source);
+
+            if (!staging.empty())
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pixelBuffer);
+
+            upload.copied += bytes;
+            budget -= std::min(budget, bytes);
+
+            if (upload.copied == mip.size) {
+
+                //sample from the finest level that is complete
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, upload.level);
+                upload.level--;
+                upload.copied = 0;
+            }
+        } while (budget > 0 && upload.level >= 0);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        if (upload.level >= 0)
+            return false;
+
+        glDeleteBuffers(1, &upload.pixelBuffer);
+
+        std::ostringstream message;
+        message << "Streamed " << upload.path << (image.compressed ? " (cooked " : " (") << image.width << "x" << image.height
+            << ") over " << upload.frames << " frames" << std::endl;
+        std::cout << message.str();
+
+        stbi_image_free(image.pixels);
+        return true;
+    }
+
+    bool TextureCache::LoadCooked(const std::string& fileName, gps::Ktx2Image& image) {
+
+        std::string cookedName = fileName + ".ktx2";
+
+        std::error_code ec;
+        auto cookedTime = std::filesystem::last_write_time(cookedName, ec);
+        if (ec || cookedTime < std::filesystem::last_write_time(fileName, ec))
+            return false;
+
+        return ReadKtx2(cookedName, image) && CompressedFormat(image.format) != 0;
+    }
+
+    void TextureCache::QueryCompressedSupport() {
+
+        GLint versionMajor = 0, versionMinor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &versionMajor);
+        glGetIntegerv(GL_MINOR_VERSION, &versionMinor);
+        etc2Supported = versionMajor > 4 || (versionMajor == 4 && versionMinor >= 3);
+
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount; i++) {
+
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+                s3tcSupported = true;
+            if (strcmp(extension, "GL_ARB_ES3_compatibility") == 0)
+                etc2Supported = true;
+        }
+    }
+
+    GLenum TextureCache::CompressedFormat(uint32_t ktx2Format) {
+
+        //S3TC and ETC2 enums, not always present in the core profile headers
+        switch (ktx2Format) {
+        case gps::KTX2_FORMAT_BC1_RGB_UNORM:
+            return s3tcSupported ? 0x83F0 : 0;  // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+        case gps::KTX2_FORMAT_BC1_RGB_SRGB:
+            return s3tcSupported ? 0x8C4C : 0;  // GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+        case gps::KTX2_FORMAT_ETC2_RGB8_UNORM:
+            return etc2Supported ? 0x9274 : 0;  // GL_COMPRESSED_RGB8_ETC2
+        case gps::KTX2_FORMAT_ETC2_RGB8_SRGB:
+            return etc2Supported ? 0x9275 : 0;  // GL_COMPRESSED_SRGB8_ETC2
+        default:
+            return 0;
+        }
+    }
+
+    // Decodes an image file to RGBA8 pixels - no GL calls
+    gps::ImageData TextureCache::DecodeImage(const char* fileName, const unsigned char* fileData, size_t fileSize) {
+
+        gps::ImageData image;
+        int x = 0, y = 0, n;
+        int force_channels = 4;
+        unsigned char* image_data = NULL;
+
+        if (fileData && fileSize > 0)
+            image_data = stbi_load_from_memory(fileData, (int)fileSize, &x, &y, &n, force_channels);
+
+        image.width = x;
+        image.height = y;
+        image.pixels = image_data;
+
+        if (!image_data) {
+            fprintf(stderr, "ERROR: could not load %s\n", fileName);
+            return image;
+        }
+        // NPOT check
+        if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
+            fprintf(
+                stderr, "WARNING: texture %s is not power-of-2 dimensions\n", fileName
+            );
+        }
+
+        //halve down to 1x1 here so the render thread never generates mipmaps
+        image.mipmaps = std::make_shared<std::vector<std::vector<unsigned char>>>();
+        const unsigned char* level = image_data;
+        int levelWidth = x, levelHeight = y;
+        while (levelWidth > 1 || levelHeight > 1) {
+
+            image.mipmaps->push_back(gps::Downsample(level, levelWidth, levelHeight, true));
+            level = image.mipmaps->back().data();
+            levelWidth = std::max(1, levelWidth / 2);
+            levelHeight = std::max(1, levelHeight / 2);
+        }
+
+        return image;
+    }
+}
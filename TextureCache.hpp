@@ -0,0 +1,134 @@
+#ifndef TextureCache_hpp
+#define TextureCache_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "ThreadPool.hpp"
+#include "Ktx2.hpp"
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    // Decoded RGBA8 pixels in file order (top row first) with their mip chain
+    // down to 1x1 - both are flipped for OpenGL while being staged - or the
+    // block-compressed mip chain of a cooked .ktx2 file, stored already flipped
+    struct ImageData {
+
+        int width;
+        int height;
+        unsigned char* pixels;
+        std::shared_ptr<std::vector<std::vector<unsigned char>>> mipmaps;
+        std::shared_ptr<gps::Ktx2Image> compressed;
+    };
+
+    // Process-wide registry of 2D textures shared by every Model3D.
+    // Images are identified by a hash of their file contents, checked against
+    // the size and bytes of the file already loaded under that hash, so
+    // identical files in different folders are decoded and uploaded only once.
+    // Each Acquire adds a reference that must be dropped with Release.
+    //
+    // Loading never blocks the render thread: Acquire returns a texture
+    // holding a 1x1 placeholder, the image and its mip chain are decoded on
+    // worker threads and Update streams them into the same texture through a
+    // pixel buffer object in row bands within a per-frame byte budget,
+    // smallest level first, so a blurry version appears after one frame.
+    class TextureCache {
+
+    public:
+        static TextureCache& Instance();
+
+        // Bytes uploaded per Update call, 0 for no limit. At least one row of
+        // one texture is uploaded per call, whatever the budget.
+        static size_t uploadBudget;
+
+        // Starts decoding the image on a worker thread unless an image with the
+        // same contents is already loaded or being decoded. Thread-safe.
+        void RequestDecode(const std::string& path);
+
+        // Returns the texture for the image - a placeholder until it is streamed.
+        // Must be called on the thread owning the GL context.
+        GLuint Acquire(const std::string& path);
+
+        // Drops a reference and deletes the texture when none are left
+        void Release(GLuint textureId);
+
+        // Advances the pending uploads - call once per frame on the GL thread
+        void Update();
+
+        // Number of textures still showing their placeholder
+        size_t PendingUploads() const;
+
+        // Decodes an image file to RGBA8 pixels and builds its mip chain - no GL calls
+        static gps::ImageData DecodeImage(const char* fileName, const unsigned char* fileData, size_t fileSize);
+
+        // Loads <fileName>.ktx2 written by the texcook tool when it is newer than
+        // the source image and the GPU supports its format - no GL calls
+        static bool LoadCooked(const std::string& fileName, gps::Ktx2Image& image);
+
+        // Detects the compressed formats the context supports - call once on
+        // the GL thread before any texture is requested
+        static void QueryCompressedSupport();
+
+        // GL internal format for a cooked texture, 0 when it is not supported
+        static GLenum CompressedFormat(uint32_t ktx2Format);
+
+    private:
+        struct Entry {
+
+            GLuint id;
+            int refCount;
+            std::shared_future<gps::ImageData> decoded;
+            // the file the entry was loaded from, to compare others with
+            std::string path;
+            size_t fileSize;
+        };
+
+        struct Upload {
+
+            uint64_t key;
+            GLuint id;
+            std::string path;
+            std::shared_future<gps::ImageData> decoded;
+            GLuint pixelBuffer;
+            int level;      // mip level being staged, -1 before the storage is allocated
+            size_t copied;  // bytes of that level already uploaded
+            int frames;
+        };
+
+        TextureCache();
+
+        // Creates a texture object whose only level is a 1x1 placeholder
+        static GLuint CreatePlaceholder();
+
+        // Uploads up to budget bytes of the image in row bands, allocating the
+        // texture storage on the first call; returns true once it is finished
+        bool StreamUpload(Upload& upload, size_t& budget);
+
+        static bool s3tcSupported;
+        static bool etc2Supported;
+
+        gps::ThreadPool decodePool;
+
+        mutable std::mutex mutex;
+        // paths of the loaded entries; released entries drop theirs
+        std::unordered_map<std::string, uint64_t> pathKeys;
+        std::unordered_map<uint64_t, Entry> entries;
+        std::unordered_map<GLuint, uint64_t> textureKeys;
+        std::vector<Upload> uploads;
+    };
+}
+
+#endif /* TextureCache_hpp */
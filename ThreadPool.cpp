@@ -0,0 +1,52 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    ThreadPool::ThreadPool(unsigned threadCount) : stopping(false) {
+
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned i = 0; i < threadCount; i++)
+            workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+
+    ThreadPool::~ThreadPool() {
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+
+        //workers drain the remaining tasks before exiting
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    unsigned ThreadPool::GetThreadCount() const {
+
+        return (unsigned)workers.size();
+    }
+
+    void ThreadPool::WorkerLoop() {
+
+        while (true) {
+
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+                if (tasks.empty())
+                    return;
+
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Fixed set of worker threads consuming a FIFO of tasks.
+    // Tasks must not block on other tasks queued on the same pool.
+    class ThreadPool {
+
+    public:
+        // threadCount == 0 uses one worker per hardware thread
+        explicit ThreadPool(unsigned threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        template<typename F>
+        auto Submit(F task) -> std::future<decltype(task())> {
+
+            typedef decltype(task()) Result;
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+            std::future<Result> result = packaged->get_future();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.push([packaged]() { (*packaged)(); });
+            }
+            condition.notify_one();
+            return result;
+        }
+
+        unsigned GetThreadCount() const;
+
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping;
+
+        void WorkerLoop();
+    };
+}
+
+#endif /* ThreadPool_hpp */
@@ -16,9 +16,31 @@
 #include "Shader.hpp"
 #include "Model3D.hpp"
 #include "Camera.hpp"
+#include "CascadedShadowMap.hpp"
+#include "Frustum.hpp"
+#include "GBuffer.hpp"
+#include "GeometryArena.hpp"
+#include "GpuTimer.hpp"
+#include "InstanceBuffer.hpp"
+#include "LightClusters.hpp"
 #include "SkyBox.hpp"
-
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "ObjParser.hpp"
+#include "ProgramCache.hpp"
+#include "RenderQueue.hpp"
+#include "SceneBVH.hpp"
+#include "ShaderManager.hpp"
+#include "ThreadPool.hpp"
+#include "TextureCache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <thread>
 
 int glWindowWidth = 800;
 int glWindowHeight = 600;
@@ -31,23 +53,56 @@ bool firstMouse = true;
 float yaw = -90.0f; 
 float pitch = 0.0f;
 
-const unsigned int SHADOW_WIDTH = 8184;
-const unsigned int SHADOW_HEIGHT = 8184;
+const float CAMERA_NEAR_PLANE = 0.1f;
+const float CAMERA_FAR_PLANE = 1000.0f;
+//view depth where shadows end - fog hides everything past it
+const float SHADOW_DISTANCE = 400.0f;
+int shadowCascadeCount = 4;
+GLsizei shadowMapResolution = 2048;
 
 glm::mat4 model;
-GLuint modelLoc;
 glm::mat4 view;
-GLuint viewLoc;
 glm::mat4 projection;
-GLuint projectionLoc;
 glm::mat3 normalMatrix;
-GLuint normalMatrixLoc;
+GLint normalMatrixLoc;
 glm::mat4 lightRotation;
 
 glm::vec3 lightDir;
-GLuint lightDirLoc;
 glm::vec3 lightColor;
-GLuint lightColorLoc;
+GLint lightColorLoc;
+
+//mirrors the std140 FrameUniforms block declared in the shaders
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 lightSpaceTrMatrices[gps::CascadedShadowMap::maxCascades];
+    glm::vec4 cascadeSplits;
+    glm::vec4 cascadeBias;
+    glm::vec3 lightDir;
+    float pad0;
+    glm::vec3 pointLightPos;
+    GLint cascadeCount;
+};
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+GLuint frameUniformBuffer;
+
+gps::RenderQueue renderQueue;
+gps::RenderStats lastFrameStats;
+
+//static meshes of the scene; the flying airplane is culled on its own
+gps::SceneBVH sceneBVH;
+std::vector<gps::MeshInstance> airplaneInstances;
+std::vector<const gps::MeshInstance*> visibleInstances;
+//shadow casters per cascade: the cached static scene and the moving airplane
+std::vector<const gps::MeshInstance*> staticCasters[gps::CascadedShadowMap::maxCascades];
+std::vector<const gps::MeshInstance*> dynamicCasters[gps::CascadedShadowMap::maxCascades];
+int staticLayersRendered;
+int lastStaticLayersRendered;
+gps::CullStats cullStats;
+gps::CullStats lastCullStats;
+gps::CullStats casterCullStats;
+gps::CullStats lastCasterCullStats;
+bool frustumCulling = true;
 
 gps::Camera myCamera(
                 glm::vec3(0.0f, 2.0f, 5.5f), 
@@ -70,14 +125,90 @@ gps::Shader myCustomShader;
 gps::Shader lightShader;
 gps::Shader screenQuadShader;
 gps::Shader depthMapShader;
+gps::Shader instancedShader;
+gps::Shader instancedDepthShader;
+gps::Shader prepassShader;
+gps::Shader instancedPrepassShader;
+gps::Shader overdrawShader;
+gps::Shader instancedOverdrawShader;
+gps::Shader gBufferShader;
+gps::Shader instancedGBufferShader;
+gps::Shader deferredLightingShader;
 
 gps::SkyBox mySkyBox;
 gps::Shader skyboxShader;
 
-GLuint shadowMapFBO;
-GLuint depthMapTexture;
+const uint32_t LIT_FEATURES = gps::SHADER_HAS_SPECULAR_MAP | gps::SHADER_SHADOWS | gps::SHADER_POINT_LIGHTS | gps::SHADER_FOG;
+//the deferred lighting pass reads the specular mask from the G-buffer
+const uint32_t DEFERRED_LIGHTING_FEATURES = gps::SHADER_SHADOWS | gps::SHADER_POINT_LIGHTS | gps::SHADER_FOG;
+
+//programs with permutations build every variant at startup, so none compiles mid-frame
+struct ShaderSources {
+    gps::Shader* shader;
+    const char* vertex;
+    const char* fragment;
+    uint32_t permutations;
+};
+const ShaderSources SHADER_PROGRAMS[] = {
+    { &myCustomShader, "shaders/shaderStart.vert", "shaders/shaderStart.frag", LIT_FEATURES },
+    { &lightShader, "shaders/lightCube.vert", "shaders/lightCube.frag", 0 },
+    { &screenQuadShader, "shaders/screenQuad.vert", "shaders/screenQuad.frag", 0 },
+    { &depthMapShader, "shaders/depthMap.vert", "shaders/depthMap.frag", 0 },
+    { &instancedShader, "shaders/shaderStartInstanced.vert", "shaders/shaderStart.frag", LIT_FEATURES },
+    { &instancedDepthShader, "shaders/depthMapInstanced.vert", "shaders/depthMap.frag", 0 },
+    { &prepassShader, "shaders/depthPrepass.vert", "shaders/depthMap.frag", 0 },
+    { &instancedPrepassShader, "shaders/depthPrepassInstanced.vert", "shaders/depthMap.frag", 0 },
+    { &overdrawShader, "shaders/shaderStart.vert", "shaders/overdraw.frag", 0 },
+    { &instancedOverdrawShader, "shaders/shaderStartInstanced.vert", "shaders/overdraw.frag", 0 },
+    { &gBufferShader, "shaders/shaderStart.vert", "shaders/gbuffer.frag", gps::SHADER_HAS_SPECULAR_MAP },
+    { &instancedGBufferShader, "shaders/shaderStartInstanced.vert", "shaders/gbuffer.frag", gps::SHADER_HAS_SPECULAR_MAP },
+    { &deferredLightingShader, "shaders/screenQuad.vert", "shaders/deferredLighting.frag", DEFERRED_LIGHTING_FEATURES },
+    { &skyboxShader, "shaders/skyboxShader.vert", "shaders/skyboxShader.frag", 0 },
+};
+gps::ShaderManager shaderManager;
+
+gps::CascadedShadowMap shadowMap;
+
+//runway, taxiway and apron lights, see buildAirfieldLights
+gps::LightClusters lightClusters;
+std::vector<gps::PointLight> airfieldLights;
+int airfieldLightCount = 0;
+//the blinking red light at the airplane, black while it is off
+glm::vec3 pointLightColor;
+//frame features of the forward path's shaderStart.frag variants (H, G)
+bool shadowsEnabled = true;
+bool fogEnabled = true;
+gps::GpuTimer shadowPassTimer;
+//main pass: prepass and lit pass, and the samples the lit pass shaded
+gps::GpuTimer mainPassTimer;
+gps::GpuTimer litSamplesPassed(GL_SAMPLES_PASSED);
+GLint framebufferSamples = 1;
+
+//extra aircraft parked in a grid behind the airport, see buildFleet
+gps::InstanceBuffer flydubaiFleet;
+gps::InstanceBuffer cityjetFleet;
+std::vector<gps::InstanceData> flydubaiInstances;
+std::vector<gps::InstanceData> cityjetInstances;
+int fleetSize = 0;
+//one glDrawElementsInstanced per mesh instead of one draw per aircraft
+bool instancedFleet = true;
+const glm::vec3 LIVERY_TINTS[4] = {
+    glm::vec3(1.0f, 1.0f, 1.0f),
+    glm::vec3(1.0f, 0.75f, 0.75f),
+    glm::vec3(0.75f, 0.85f, 1.0f),
+    glm::vec3(0.85f, 1.0f, 0.75f)
+};
 
 bool showDepthMap;
+//lay down depth first so the lit pass shades each pixel once (Z)
+bool depthPrepass = false;
+//heat map of the lit pass fragments per pixel (O), forward path only
+bool showOverdraw = false;
+//G-buffer and a full-screen lighting pass instead of lighting while rasterizing (--deferred)
+bool deferredShading = false;
+// print the load time of every shader program at startup
+bool shaderTimes = false;
+gps::GBuffer gBuffer;
 bool attachCameraToAirplane;
 
 float flightAngle = 0.0f; 
@@ -106,6 +237,12 @@ void windowResizeCallback(GLFWwindow* window, int width, int height) {
     fprintf(stdout, "window resized to width: %d , and height: %d\n", width, height);
 }
 
+//average depth test passes of a pixel, from a GL_SAMPLES_PASSED count
+double litFragmentsPerPixel(double samplesPassed) {
+    double samples = (double)retina_width * retina_height * framebufferSamples;
+    return samples > 0.0 ? samplesPassed / samples : 0.0;
+}
+
 void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GL_TRUE);
@@ -123,6 +260,40 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
     if (key == GLFW_KEY_F && action == GLFW_PRESS) {
         attachCameraToAirplane = !attachCameraToAirplane;
     }
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+        depthPrepass = !depthPrepass;
+        printf("Depth prepass %s\n", depthPrepass ? "on" : "off");
+    }
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        showOverdraw = !showOverdraw;
+    }
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        shadowsEnabled = !shadowsEnabled;
+        printf("Shadows %s\n", shadowsEnabled ? "on" : "off");
+    }
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        fogEnabled = !fogEnabled;
+        printf("Fog %s\n", fogEnabled ? "on" : "off");
+    }
+    if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+        const gps::RenderStats& stats = lastFrameStats;
+        printf("Render queue: %u draws in %u calls (%u instances) | program binds %u (%u avoided) | VAO binds %u (%u avoided) | "
+            "texture binds %u (%u avoided) | uniform updates %u (%u avoided)\n",
+            stats.draws, stats.drawCalls, stats.instances, stats.programBinds, stats.programBindsAvoided, stats.vaoBinds, stats.vaoBindsAvoided,
+            stats.textureBinds, stats.textureBindsAvoided, stats.uniformUpdates, stats.uniformUpdatesAvoided);
+        printf("Culling: %u of %u meshes visible | %u BVH nodes visited | %.3f ms\n",
+            lastCullStats.visible, lastCullStats.total, lastCullStats.nodesVisited, lastCullStats.cullTime);
+        printf("Shadow casters: %u of %u meshes | %u BVH nodes visited | %.3f ms\n",
+            lastCasterCullStats.visible, lastCasterCullStats.total, lastCasterCullStats.nodesVisited, lastCasterCullStats.cullTime);
+        printf("Shadow cache: %d of %d static cascades re-rendered\n", lastStaticLayersRendered, shadowMap.GetCascadeCount());
+        printf("Shadow pass: %.3f ms GPU (%s)\n", shadowPassTimer.GetLast(),
+            gps::Mesh::depthStreams ? "position-only streams" : "full vertices");
+        printf("Main pass: %.3f ms GPU | %.2f lit fragments per pixel (depth prepass %s)\n", mainPassTimer.GetLast(),
+            litFragmentsPerPixel(litSamplesPassed.GetLast()), depthPrepass ? "on" : "off");
+        const gps::LightClusterStats& lightStats = lightClusters.GetStats();
+        printf("Point lights: %u of %u visible | %u cluster entries, at most %u per cluster | binned in %.3f ms\n",
+            lightStats.visibleLights, lightStats.lights, lightStats.lightIndices, lightStats.maxClusterLights, lightStats.binTime);
+    }
 
     if (key >= 0 && key < 1024)
     {
@@ -244,6 +415,9 @@ bool initOpenGLWindow()
 void initOpenGLState()
 {
     glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+    //GL_SAMPLES_PASSED counts samples, the lit pass statistics want pixels
+    glGetIntegerv(GL_SAMPLES, &framebufferSamples);
+    framebufferSamples = framebufferSamples > 0 ? framebufferSamples : 1;
     glViewport(0, 0, retina_width, retina_height);
 
     glEnable(GL_BLEND);
@@ -254,88 +428,207 @@ void initOpenGLState()
     glFrontFace(GL_CCW);
 
     glEnable(GL_FRAMEBUFFER_SRGB);
+
+    gps::TextureCache::QueryCompressedSupport();
+    gps::RenderQueue::QueryMultiDrawSupport();
+}
+
+//only submitted, the driver compiles while the scene loads; see finishShaders
+void initShaders() {
+    for (const ShaderSources& program : SHADER_PROGRAMS) {
+        shaderManager.Add(*program.shader, program.vertex, program.fragment, program.permutations);
+        shaderManager.AddVariants(*program.shader);
+    }
+}
+
+//progress bar drawn with scissored clears, as no program may be ready yet
+void drawLoadingScreen(float progress) {
+    glViewport(0, 0, retina_width, retina_height);
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    GLint barX = retina_width / 4;
+    GLint barY = retina_height / 2;
+    GLsizei barWidth = retina_width / 2;
+    GLsizei barHeight = std::max(retina_height / 40, 4);
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(barX, barY, barWidth, barHeight);
+    glClearColor(0.25f, 0.25f, 0.25f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glScissor(barX, barY, (GLsizei)(barWidth * progress), barHeight);
+    glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+
+    glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
 }
 
 void initObjects() {
-    airport.LoadModel("objects/airport/airport.obj");
-    flydubai.LoadModel("objects/flydubai/flydubai.obj");
-    cityjet.LoadModel("objects/cityjet/cityjet.obj");
-    house.LoadModel("objects/house/house.obj");
-    screenQuad.LoadModel("objects/quad/quad.obj");
+    double start = glfwGetTime();
+
+    //parse the models on worker threads and upload each one on this thread
+    //as soon as it is ready; textures keep streaming in during the first frames
+    gps::ThreadPool loaderPool;
+    std::vector<std::pair<gps::Model3D*, std::string>> models = {
+        { &airport, "objects/airport/airport.obj" },
+        { &flydubai, "objects/flydubai/flydubai.obj" },
+        { &cityjet, "objects/cityjet/cityjet.obj" },
+        { &house, "objects/house/house.obj" },
+        { &screenQuad, "objects/quad/quad.obj" }
+    };
+
+    std::vector<std::future<void>> parsed;
+    for (auto& entry : models) {
+        gps::Model3D* object = entry.first;
+        std::string fileName = entry.second;
+        parsed.push_back(loaderPool.Submit([object, fileName]() {
+            object->ParseModel(fileName);
+        }));
+    }
+
+    //in completion order, so a slow airport.obj parse does not hold up the models already parsed
+    std::vector<bool> uploaded(models.size(), false);
+    size_t remaining = models.size();
+    while (remaining > 0) {
+        bool progressed = false;
+        for (size_t i = 0; i < models.size(); i++) {
+            if (uploaded[i] || parsed[i].wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                continue;
+            parsed[i].get();
+            models[i].first->UploadModel();
+            uploaded[i] = true;
+            remaining--;
+            progressed = true;
+        }
+        //notes shader programs completing meanwhile, for the compile wall time
+        shaderManager.Poll();
+        if (!progressed) {
+            //the scene and the shaders fill half of the bar each
+            float sceneProgress = (float)(models.size() - remaining) / models.size();
+            drawLoadingScreen(0.5f * (sceneProgress + shaderManager.GetProgress()));
+            glfwSwapBuffers(glWindow);
+            glfwPollEvents();
+        }
+    }
+
+    printf("Scene loaded in %.1f ms on %u loader threads (mesh cache %s, geometry arena %s)\n", (glfwGetTime() - start) * 1000.0,
+        loaderPool.GetThreadCount(), gps::MeshCache::enabled ? "on" : "off", gps::GeometryArena::enabled ? "on" : "off");
 }
 
-void initShaders() {
-    myCustomShader.loadShader("shaders/shaderStart.vert", "shaders/shaderStart.frag");
-    myCustomShader.useShaderProgram();
-    
-    lightShader.loadShader("shaders/lightCube.vert", "shaders/lightCube.frag");
-    lightShader.useShaderProgram();
-    
-    screenQuadShader.loadShader("shaders/screenQuad.vert", "shaders/screenQuad.frag");
-    screenQuadShader.useShaderProgram();
+//loading screen until every program is linked, then the uniform block bindings
+void finishShaders() {
+    while (!shaderManager.Update()) {
+        drawLoadingScreen(0.5f * (1.0f + shaderManager.GetProgress()));
+        glfwSwapBuffers(glWindow);
+        glfwPollEvents();
+    }
 
-    depthMapShader.loadShader("shaders/depthMap.vert", "shaders/depthMap.frag");
+    if (shaderTimes)
+        for (const ShaderSources& program : SHADER_PROGRAMS)
+            printf("  %-36s %-32s %8.2f ms %s\n", program.vertex, program.fragment,
+                program.shader->getLoadTime(), program.shader->isFromBinaryCache() ? "cached" : "compiled");
+
+    //parallel compiles are seen complete while the scene loads, so their wall time compares with the serial one;
+    //batched compiles can only be checked after the load, which their wall time then includes
+    const gps::ShaderLoadStats& stats = shaderManager.GetStats();
+    const char* mode = !gps::ShaderManager::parallel ? "serial" :
+        gps::ShaderManager::IsParallelCompileSupported() ? "parallel" : "batched";
+    printf("Shaders: %u programs in %.1f ms wall, %.1f ms of it alongside the scene load | main thread %.1f ms submitting + %.1f ms finishing "
+        "(%s compile, %u from the binary cache%s)\n",
+        stats.programs, stats.wallTime, stats.overlapTime, stats.submitTime, stats.finishTime, mode, stats.cached,
+        gps::ProgramCache::enabled && gps::ProgramCache::IsSupported() ? "" : ", cache off");
+
+    gps::Shader* frameShaders[] = { &myCustomShader, &lightShader, &depthMapShader, &skyboxShader,
+        &instancedShader, &instancedDepthShader, &prepassShader, &instancedPrepassShader,
+        &overdrawShader, &instancedOverdrawShader, &gBufferShader, &instancedGBufferShader, &deferredLightingShader };
+    for (gps::Shader* shader : frameShaders)
+        shader->bindUniformBlock("FrameUniforms", FRAME_UNIFORMS_BINDING);
+}
 
-    skyboxShader.loadShader("shaders/skyboxShader.vert", "shaders/skyboxShader.frag");
-    skyboxShader.useShaderProgram();
+//uniforms of a shaderStart.frag variant outside FrameUniforms that change every frame
+void setLitFrameUniforms(gps::Shader& shader) {
+    shader.useShaderProgram();
+    glUniform3fv(shader.getUniformLocation("pointLightColor"), 1, glm::value_ptr(pointLightColor));
+    lightClusters.Bind(shader, retina_width, retina_height);
+}
+
+//all of them, for a variant that was just compiled
+void setupLitVariant(gps::Shader& shader) {
+    shader.useShaderProgram();
+    glUniform3fv(shader.getUniformLocation("lightColor"), 1, glm::value_ptr(lightColor));
+    glUniform3fv(shader.getUniformLocation("liveryTints"), 4, glm::value_ptr(LIVERY_TINTS[0]));
+    glUniform1i(shader.getUniformLocation("shadowMap"), 3);
+    setLitFrameUniforms(shader);
+}
+
+void setupGBufferVariant(gps::Shader& shader) {
+    shader.useShaderProgram();
+    glUniform3fv(shader.getUniformLocation("liveryTints"), 4, glm::value_ptr(LIVERY_TINTS[0]));
+}
+
+void setupDeferredLightingVariant(gps::Shader& shader) {
+    shader.useShaderProgram();
+    glUniform3fv(shader.getUniformLocation("lightColor"), 1, glm::value_ptr(lightColor));
+    glUniform1i(shader.getUniformLocation("shadowMap"), 3);
+}
+
+//features the H and G toggles and the point lights leave on this frame, and the red light's colour
+uint32_t updateFrameFeatures() {
+    bool isBlinking = sin(glfwGetTime() * 10.0f) > 0.0;
+    pointLightColor = isBlinking ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f);
+
+    //each mesh then drops HAS_SPECULAR_MAP if its material has no specular map
+    uint32_t features = gps::SHADER_HAS_SPECULAR_MAP;
+    if (shadowsEnabled)
+        features |= gps::SHADER_SHADOWS;
+    if (isBlinking || !airfieldLights.empty())
+        features |= gps::SHADER_POINT_LIGHTS;
+    if (fogEnabled)
+        features |= gps::SHADER_FOG;
+    return features;
 }
 
 void initUniforms() {
     myCustomShader.useShaderProgram();
 
     model = glm::mat4(1.0f);
-    modelLoc = glGetUniformLocation(myCustomShader.shaderProgram, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(myCustomShader.getUniformLocation("model"), 1, GL_FALSE, glm::value_ptr(model));
 
     view = myCamera.getViewMatrix();
-    viewLoc = glGetUniformLocation(myCustomShader.shaderProgram, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
     
     normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
-    normalMatrixLoc = glGetUniformLocation(myCustomShader.shaderProgram, "normalMatrix");
+    normalMatrixLoc = myCustomShader.getUniformLocation("normalMatrix");
     glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
     
-    projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
-    projectionLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height,
+        CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
 
     lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
     lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-    lightDirLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightDir");   
-    glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
 
     lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
-    lightColorLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightColor");
-    glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
-
-    lightShader.useShaderProgram();
-    glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    lightColorLoc = myCustomShader.getUniformLocation("lightColor");
+
+    //every variant was built behind the loading screen
+    myCustomShader.setVariantSetup(setupLitVariant);
+    instancedShader.setVariantSetup(setupLitVariant);
+    instancedGBufferShader.setVariantSetup(setupGBufferVariant);
+    deferredLightingShader.setVariantSetup(setupDeferredLightingVariant);
+
+    //view, projection and light state for every program, refreshed once per frame
+    glGenBuffers(1, &frameUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, frameUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
 void initFBO() {
-    glGenFramebuffers(1, &shadowMapFBO);
-
-    glGenTextures(1, &depthMapTexture);
-    glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-    
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-        SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture, 0);
-
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
+    shadowMap.Init(shadowCascadeCount, shadowMapResolution);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    printf("Shadow map: %d cascades of %dx%d (%.1f MB)\n", shadowMap.GetCascadeCount(), shadowMap.GetResolution(),
+        shadowMap.GetResolution(), shadowMap.GetMemorySize() / (1024.0 * 1024.0));
 }
 
 void initSkybox() {
@@ -349,15 +642,163 @@ void initSkybox() {
     mySkyBox.Load(faces);
 }
 
-glm::mat4 computeLightSpaceTrMatrix() {
-    glm::mat4 lightView = glm::lookAt(glm::vec3(lightDir), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    const GLfloat near_plane = 0.1f, far_plane = 400.0f;
-    glm::mat4 lightProjection = glm::ortho(-800.0f, 800.0f, -800.0f, 800.0f, near_plane, far_plane);
-    glm::mat4 lightSpaceTrMatrix = lightProjection * lightView;
-    return lightSpaceTrMatrix;
+//follows J/L like the shading does, so turning the light invalidates the static shadow cache
+glm::mat4 computeLightView() {
+    glm::vec3 direction = glm::normalize(glm::vec3(lightRotation * glm::vec4(lightDir, 0.0f)));
+    return glm::lookAt(direction, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void updateCamera() {
+    if (attachCameraToAirplane) {
+        float radius = 80.0f;
+        float airplaneX = cos(flightAngle) * radius;
+        float airplaneZ = sin(flightAngle) * radius;
+        
+        glm::vec3 cameraPos = glm::vec3(
+            cos(flightAngle - 0.2f) * (radius + 10.0f), 
+            20.0f, 
+            sin(flightAngle - 0.2f) * (radius + 10.0f)
+        );
+        glm::vec3 center = glm::vec3(0.0f, 0.0f, 0.0f);
+        view = glm::lookAt(cameraPos, center, glm::vec3(0.0f, 1.0f, 0.0f));
+    } else {
+        view = myCamera.getViewMatrix();
+    }
+
+    lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void updateFrameUniforms() {
+    FrameUniforms frame;
+    frame.view = view;
+    frame.projection = projection;
+    for (int cascade = 0; cascade < gps::CascadedShadowMap::maxCascades; cascade++) {
+        bool used = cascade < shadowMap.GetCascadeCount();
+        frame.lightSpaceTrMatrices[cascade] = used ? shadowMap.GetCascade(cascade).lightSpaceTrMatrix : glm::mat4(1.0f);
+        frame.cascadeSplits[cascade] = used ? shadowMap.GetCascade(cascade).splitDepth : 0.0f;
+        frame.cascadeBias[cascade] = used ? shadowMap.GetCascade(cascade).depthBias : 0.0f;
+    }
+    frame.lightDir = glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir;
+    frame.pad0 = 0.0f;
+    frame.pointLightPos = glm::vec3(10.0f, 0.0f, -43.0f);
+    frame.cascadeCount = shadowMap.GetCascadeCount();
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+//rows of lights 3 units apart across the ground of the scene: white runway
+//lines, blue and green taxiway lines and amber apron lights
+void buildAirfieldLights(int count) {
+    const glm::vec3 colors[] = {
+        glm::vec3(1.0f, 0.95f, 0.85f),
+        glm::vec3(0.2f, 0.4f, 1.0f),
+        glm::vec3(0.2f, 1.0f, 0.35f),
+        glm::vec3(1.0f, 0.6f, 0.15f)
+    };
+    const float spacing = 3.0f;
+    const float intensity = 3.0f;
+
+    airfieldLights.clear();
+    airfieldLightCount = count;
+    if (count <= 0)
+        return;
+
+    glm::vec3 sceneMin(-100.0f), sceneMax(100.0f);
+    sceneBVH.GetBounds(sceneMin, sceneMax);
+
+    int perRow = std::max(1, (int)((sceneMax.x - sceneMin.x) / spacing));
+    int rows = (count + perRow - 1) / perRow;
+    float rowSpacing = (sceneMax.z - sceneMin.z) / (rows + 1);
+
+    for (int i = 0; i < count; i++) {
+        int row = i / perRow;
+        int column = i % perRow;
+
+        //just above the ground, like the red light at pointLightPos
+        gps::PointLight light;
+        light.position = glm::vec3(sceneMin.x + (column + 0.5f) * spacing, 0.5f, sceneMin.z + (row + 1) * rowSpacing);
+        light.radius = 6.0f;
+        light.color = colors[row % 4] * intensity;
+        airfieldLights.push_back(light);
+    }
+}
+
+void buildFleet(int count) {
+    fleetSize = count;
+    flydubaiInstances.clear();
+    cityjetInstances.clear();
+
+    //the models have their airport positions baked in, so the grid offsets them
+    const float spacing = 60.0f;
+    int side = (int)ceil(sqrt((double)count));
+    for (int i = 0; i < count; i++) {
+        int row = i / side;
+        int column = i % side;
+
+        gps::InstanceData instance;
+        instance.model = glm::translate(glm::mat4(1.0f),
+            glm::vec3((column - side / 2) * spacing, 0.0f, -(row + 1) * spacing));
+        instance.livery = (float)(i % 4);
+        instance.padding[0] = instance.padding[1] = instance.padding[2] = 0.0f;
+
+        if (i % 2 == 0)
+            flydubaiInstances.push_back(instance);
+        else
+            cityjetInstances.push_back(instance);
+    }
+
+    flydubaiFleet.Upload(flydubaiInstances);
+    cityjetFleet.Upload(cityjetInstances);
+
+    //the parked fleet is part of the cached static shadows
+    shadowMap.InvalidateStatic();
+}
+
+//depthOnly draws from the position-only streams, for programs that read nothing else
+void drawFleet(gps::Shader& shader, gps::Shader& fleetShader, bool depthOnly = false) {
+    if (fleetSize == 0)
+        return;
+
+    if (instancedFleet) {
+        if (depthOnly) {
+            flydubai.SubmitDepthInstanced(renderQueue, fleetShader, flydubaiFleet);
+            cityjet.SubmitDepthInstanced(renderQueue, fleetShader, cityjetFleet);
+        }
+        else {
+            flydubai.SubmitInstanced(renderQueue, fleetShader, flydubaiFleet);
+            cityjet.SubmitInstanced(renderQueue, fleetShader, cityjetFleet);
+        }
+        return;
+    }
+
+    //reference path for the benchmark: same transforms, no livery tint
+    for (const gps::InstanceData& instance : flydubaiInstances) {
+        if (depthOnly)
+            flydubai.SubmitDepth(renderQueue, shader, instance.model);
+        else
+            flydubai.Submit(renderQueue, shader, instance.model);
+    }
+    for (const gps::InstanceData& instance : cityjetInstances) {
+        if (depthOnly)
+            cityjet.SubmitDepth(renderQueue, shader, instance.model);
+        else
+            cityjet.Submit(renderQueue, shader, instance.model);
+    }
+}
+
+void initSceneBVH() {
+    std::vector<gps::MeshInstance> instances;
+    glm::mat4 model = glm::mat4(1.0f);
+    airport.AddInstances(model, instances);
+    cityjet.AddInstances(model, instances);
+    flydubai.AddInstances(model, instances);
+    house.AddInstances(model, instances);
+    sceneBVH.Build(instances);
 }
 
-void drawAirplane(gps::Shader shader, bool depthPass) {
+glm::mat4 computeAirplaneModel() {
     float angle = flightAngle; 
     float radius = 100.0f;
     float airplaneX = cos(angle) * radius;
@@ -370,80 +811,275 @@ void drawAirplane(gps::Shader shader, bool depthPass) {
     model = glm::rotate(model, glm::radians(30.0f), glm::vec3(1, 0, 0));
     model = glm::rotate(model, glm::radians(40.0f), glm::vec3(0, 0, 1));
 
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    return model;
+}
+
+//Shadow casters only matter where they can darken a visible receiver: each
+//cascade's box is clipped to the light-space box around the receivers and
+//extruded from their far side back to the cascade's near plane. Cached static
+//layers outlive this frame's receivers, so they take every caster in their
+//window, and are only culled when the window has to be re-rendered.
+void cullShadowCasters(const glm::mat4& lightView) {
+    bool hasReceivers = !visibleInstances.empty();
+    glm::vec3 lightMin(0.0f), lightMax(0.0f);
+    if (hasReceivers) {
+        glm::vec3 receiversMin = visibleInstances[0]->aabbMin;
+        glm::vec3 receiversMax = visibleInstances[0]->aabbMax;
+        for (const gps::MeshInstance* instance : visibleInstances) {
+            receiversMin = glm::min(receiversMin, instance->aabbMin);
+            receiversMax = glm::max(receiversMax, instance->aabbMax);
+        }
 
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+        lightMin = glm::vec3(lightView * glm::vec4(receiversMin, 1.0f));
+        lightMax = lightMin;
+        for (int corner = 1; corner < 8; corner++) {
+            glm::vec3 point(corner & 1 ? receiversMax.x : receiversMin.x,
+                            corner & 2 ? receiversMax.y : receiversMin.y,
+                            corner & 4 ? receiversMax.z : receiversMin.z);
+            glm::vec3 lightPoint = glm::vec3(lightView * glm::vec4(point, 1.0f));
+            lightMin = glm::min(lightMin, lightPoint);
+            lightMax = glm::max(lightMax, lightPoint);
+        }
     }
 
-    flydubai.Draw(shader);
-}
+    //the airplane may fly closer to the light than the static scene reaches
+    float dynamicNear = shadowMap.GetCascade(0).nearPlane;
+    for (const gps::MeshInstance& instance : airplaneInstances) {
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point(corner & 1 ? instance.aabbMax.x : instance.aabbMin.x,
+                            corner & 2 ? instance.aabbMax.y : instance.aabbMin.y,
+                            corner & 4 ? instance.aabbMax.z : instance.aabbMin.z);
+            dynamicNear = glm::min(dynamicNear, -(lightView * glm::vec4(point, 1.0f)).z);
+        }
+    }
 
-void drawObjects(gps::Shader shader, bool depthPass) {
-    shader.useShaderProgram();
+    for (int cascade = 0; cascade < shadowMap.GetCascadeCount(); cascade++) {
+        const gps::ShadowCascade& bounds = shadowMap.GetCascade(cascade);
+        staticCasters[cascade].clear();
+        dynamicCasters[cascade].clear();
 
-    drawAirplane(shader, depthPass);
+        bool cachedStatic = gps::CascadedShadowMap::cacheStatic;
+        if (cachedStatic && shadowMap.StaticNeedsUpdate(cascade)) {
+            gps::Frustum windowFrustum(shadowMap.GetStaticMatrix(cascade));
+            sceneBVH.Cull(windowFrustum, staticCasters[cascade], casterCullStats);
+        }
 
-    glm::mat4 model = glm::mat4(1.0f); 
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+        //light view looks down -z, so the receivers' far side is -lightMin.z
+        float left = glm::max(lightMin.x, bounds.left);
+        float right = glm::min(lightMax.x, bounds.right);
+        float bottom = glm::max(lightMin.y, bounds.bottom);
+        float top = glm::min(lightMax.y, bounds.top);
+        float farPlane = glm::min(-lightMin.z, bounds.farPlane);
+        if (!hasReceivers || left >= right || bottom >= top || farPlane <= bounds.nearPlane)
+            continue;
+
+        gps::Frustum casterFrustum(glm::ortho(left, right, bottom, top, bounds.nearPlane, farPlane) * lightView);
+        if (!cachedStatic)
+            sceneBVH.Cull(casterFrustum, staticCasters[cascade], casterCullStats);
+
+        //drawn with depth clamping, so they still cast from in front of the near plane
+        gps::Frustum dynamicFrustum(glm::ortho(left, right, bottom, top, dynamicNear, farPlane) * lightView);
+        gps::SceneBVH::CullInstances(dynamicFrustum, airplaneInstances, dynamicCasters[cascade], casterCullStats);
+    }
+}
 
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+//camera-visible meshes for the main pass
+void cullScene() {
+    airplaneInstances.clear();
+    flydubai.AddInstances(computeAirplaneModel(), airplaneInstances);
+
+    visibleInstances.clear();
+    if (!frustumCulling) {
+        for (const gps::MeshInstance& instance : sceneBVH.GetInstances())
+            visibleInstances.push_back(&instance);
+        for (const gps::MeshInstance& instance : airplaneInstances)
+            visibleInstances.push_back(&instance);
+        return;
     }
-    
-    airport.Draw(shader); 
 
-    model = glm::mat4(1.0f);
-    model = glm::scale(model, glm::vec3(1.0f)); 
+    gps::Frustum frustum(projection * view);
+    sceneBVH.Cull(frustum, visibleInstances, cullStats);
+    gps::SceneBVH::CullInstances(frustum, airplaneInstances, visibleInstances, cullStats);
+}
 
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+//fits the cascades to this frame's camera, then picks the casters of each
+void updateShadowCascades() {
+    //static bounds only: the flying airplane would move the cascades' depth range every frame
+    glm::vec3 sceneMin(0.0f), sceneMax(0.0f);
+    sceneBVH.GetBounds(sceneMin, sceneMax);
+
+    glm::mat4 lightView = computeLightView();
+    shadowMap.Update(view, projection, CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE, SHADOW_DISTANCE, lightView, sceneMin, sceneMax);
+
+    if (!frustumCulling) {
+        for (int cascade = 0; cascade < shadowMap.GetCascadeCount(); cascade++) {
+            staticCasters[cascade].clear();
+            for (const gps::MeshInstance& instance : sceneBVH.GetInstances())
+                staticCasters[cascade].push_back(&instance);
+            dynamicCasters[cascade].clear();
+            for (const gps::MeshInstance& instance : airplaneInstances)
+                dynamicCasters[cascade].push_back(&instance);
+        }
+        return;
+    }
+    cullShadowCasters(lightView);
+}
 
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+void drawInstances(gps::Shader& shader, const std::vector<const gps::MeshInstance*>& instances, bool depthOnly = false) {
+    for (const gps::MeshInstance* instance : instances) {
+        if (depthOnly)
+            instance->mesh->SubmitDepth(renderQueue, shader, instance->model);
+        else
+            instance->mesh->Submit(renderQueue, shader, instance->model);
     }
 
-    cityjet.Draw(shader);
+    //sorted by program, textures and VAO; normalMatrix is derived from view
+    renderQueue.Execute(view);
+}
 
-    model = glm::mat4(1.0f);
-    
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+void drawObjects(gps::Shader& shader, gps::Shader& fleetShader, const std::vector<const gps::MeshInstance*>& instances,
+                 bool depthOnly = false) {
+    drawFleet(shader, fleetShader, depthOnly);
+    drawInstances(shader, instances, depthOnly);
+}
 
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+//the static window or the cascade itself
+void setShadowMatrix(const glm::mat4& lightSpaceTrMatrix) {
+    depthMapShader.useShaderProgram();
+    glUniformMatrix4fv(depthMapShader.getUniformLocation("lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceTrMatrix));
+    instancedDepthShader.useShaderProgram();
+    glUniformMatrix4fv(instancedDepthShader.getUniformLocation("lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceTrMatrix));
+}
+
+//shaderStart.frag while rasterizing, optionally after a depth prepass
+void drawForwardPass() {
+    glViewport(0, 0, retina_width, retina_height);
+    if (showOverdraw)
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+
+    mainPassTimer.Begin();
+
+    //depth only, from the position streams; the lit pass then only shades the nearest surface
+    if (depthPrepass) {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        drawObjects(prepassShader, instancedPrepassShader, visibleInstances, true);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
     }
 
-    flydubai.Draw(shader);
+    litSamplesPassed.Begin();
+    if (showOverdraw) {
+        glBlendFunc(GL_ONE, GL_ONE);
+        drawObjects(overdrawShader, instancedOverdrawShader, visibleInstances);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    else {
+        uint32_t features = updateFrameFeatures();
+        gps::Shader* litShaders[] = { &myCustomShader, &instancedShader };
+        for (gps::Shader* shader : litShaders) {
+            shader->setFeatures(features);
+            for (gps::Shader* variant : shader->getVariants())
+                setLitFrameUniforms(*variant);
+        }
 
-    model = glm::mat4(1.0f);
-    
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMap.GetTexture());
+
+        drawObjects(myCustomShader, instancedShader, visibleInstances);
+    }
+    litSamplesPassed.End();
 
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+    if (depthPrepass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
     }
+    mainPassTimer.End();
+}
+
+//G-buffer of the visible meshes, then one full-screen pass that shades each pixel once
+void drawDeferredPass() {
+    if (gBuffer.GetWidth() != retina_width || gBuffer.GetHeight() != retina_height)
+        gBuffer.Init(retina_width, retina_height);
+
+    mainPassTimer.Begin();
+
+    //G-buffer alpha is the specular mask, not coverage
+    glDisable(GL_BLEND);
+    gBuffer.Begin();
+    drawObjects(gBufferShader, instancedGBufferShader, visibleInstances);
+    gBuffer.End();
+    glEnable(GL_BLEND);
+
+    glViewport(0, 0, retina_width, retina_height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    deferredLightingShader.setFeatures(updateFrameFeatures());
+    gps::Shader& lightingShader = deferredLightingShader.getVariant(0);
+    lightingShader.useShaderProgram();
+    glUniform3fv(lightingShader.getUniformLocation("pointLightColor"), 1, glm::value_ptr(pointLightColor));
+
+    glm::mat4 inverseProjection = glm::inverse(projection);
+    glm::mat4 inverseView = glm::inverse(view);
+    glUniformMatrix4fv(lightingShader.getUniformLocation("inverseProjection"), 1, GL_FALSE, glm::value_ptr(inverseProjection));
+    glUniformMatrix4fv(lightingShader.getUniformLocation("inverseView"), 1, GL_FALSE, glm::value_ptr(inverseView));
 
-    house.Draw(shader);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMap.GetTexture());
+
+    gBuffer.BindTextures(lightingShader);
+    lightClusters.Bind(lightingShader, retina_width, retina_height);
+
+    //always passes, writing the G-buffer depth for the light cube and the skybox
+    litSamplesPassed.Begin();
+    glDepthFunc(GL_ALWAYS);
+    screenQuad.Draw(lightingShader);
+    glDepthFunc(GL_LESS);
+    litSamplesPassed.End();
+
+    mainPassTimer.End();
 }
 
 void renderScene() {
-    depthMapShader.useShaderProgram();
-    glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"),
-        1,
-        GL_FALSE,
-        glm::value_ptr(computeLightSpaceTrMatrix()));
-
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    
-    drawObjects(depthMapShader, true);
-    
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    lastFrameStats = renderQueue.GetStats();
+    renderQueue.ResetStats();
+    lastCullStats = cullStats;
+    cullStats = gps::CullStats();
+    lastCasterCullStats = casterCullStats;
+    casterCullStats = gps::CullStats();
+    lastStaticLayersRendered = staticLayersRendered;
+
+    updateCamera();
+    cullScene();
+    updateShadowCascades();
+    updateFrameUniforms();
+
+    //static depth only when the cascade left its window or the light turned, then the airplane over a copy of it
+    //neither path samples the shadow map without SHADOWS
+    bool shadowPass = shadowsEnabled;
+    shadowPassTimer.Begin();
+    staticLayersRendered = 0;
+    for (int cascade = 0; shadowPass && cascade < shadowMap.GetCascadeCount(); cascade++) {
+        if (shadowMap.StaticNeedsUpdate(cascade)) {
+            shadowMap.BeginStaticCascade(cascade);
+            setShadowMatrix(shadowMap.GetStaticMatrix(cascade));
+            drawObjects(depthMapShader, instancedDepthShader, staticCasters[cascade], true);
+            staticLayersRendered++;
+        }
+
+        //the airplane can leave the static scene's depth range
+        if (shadowMap.BeginDynamicCascade(cascade, !dynamicCasters[cascade].empty())) {
+            setShadowMatrix(shadowMap.GetCascade(cascade).lightSpaceTrMatrix);
+            glEnable(GL_DEPTH_CLAMP);
+            drawInstances(depthMapShader, dynamicCasters[cascade], true);
+            glDisable(GL_DEPTH_CLAMP);
+        }
+    }
+    shadowMap.End();
+    shadowPassTimer.End();
 
     if (showDepthMap) {
         glViewport(0, 0, retina_width, retina_height);
@@ -452,87 +1088,357 @@ void renderScene() {
         screenQuadShader.useShaderProgram();
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "depthMap"), 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMap.GetTexture());
+        glUniform1i(screenQuadShader.getUniformLocation("depthMap"), 0);
+        glUniform1i(screenQuadShader.getUniformLocation("depthMapLayer"), 0);
 
         glDisable(GL_DEPTH_TEST);
         screenQuad.Draw(screenQuadShader);
         glEnable(GL_DEPTH_TEST);
     }
     else {
-        glViewport(0, 0, retina_width, retina_height);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        lightClusters.Update(airfieldLights, view, projection, CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
+        if (deferredShading)
+            drawDeferredPass();
+        else
+            drawForwardPass();
 
-        myCustomShader.useShaderProgram();
+        lightShader.useShaderProgram();
 
-        float ledX = 10.0f;  
-        float ledY = 0.0f;;   
-        float ledZ = -43.0f;  
-        
-        glm::vec3 lightPos = glm::vec3(ledX, ledY, ledZ);
+        model = lightRotation;
+        model = glm::translate(model, 1.0f * lightDir);
+        model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
+        glUniformMatrix4fv(lightShader.getUniformLocation("model"), 1, GL_FALSE, glm::value_ptr(model));
+
+        lightCube.Draw(lightShader);
+    }
+    //the heat map reads best on black
+    if (!showOverdraw || deferredShading || showDepthMap)
+        mySkyBox.Draw(skyboxShader);
+}
 
-        glUniform3fv(glGetUniformLocation(myCustomShader.shaderProgram, "pointLightPos"), 1, glm::value_ptr(lightPos));
+//streams every pending texture without a budget, so benchmarks sample the
+//real images instead of the 1x1 placeholders
+void drainTextureUploads() {
+    gps::TextureCache& textureCache = gps::TextureCache::Instance();
+    size_t uploadBudget = gps::TextureCache::uploadBudget;
+    gps::TextureCache::uploadBudget = 0;
+    while (textureCache.PendingUploads() > 0) {
+        textureCache.Update();
+        if (textureCache.PendingUploads() > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    gps::TextureCache::uploadBudget = uploadBudget;
+    glFinish();
+}
 
-        double currentTime = glfwGetTime();
-        
-        int isBlinking = (sin(currentTime * 10.0f) > 0.0) ? 1 : 0;
-
-        glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "redLightStarted"), isBlinking);
-
-        if (attachCameraToAirplane) {
-            float radius = 80.0f;
-            float airplaneX = cos(flightAngle) * radius;
-            float airplaneZ = sin(flightAngle) * radius;
-            
-            glm::vec3 cameraPos = glm::vec3(
-                cos(flightAngle - 0.2f) * (radius + 10.0f), 
-                20.0f, 
-                sin(flightAngle - 0.2f) * (radius + 10.0f)
-            );
-            glm::vec3 center = glm::vec3(0.0f, 0.0f, 0.0f);
-            view = glm::lookAt(cameraPos, center, glm::vec3(0.0f, 1.0f, 0.0f));
-        } else {
-            view = myCamera.getViewMatrix();
+void runInstancingBenchmark() {
+    const int counts[] = { 1, 10, 100, 1000, 10000 };
+    const int frames = 60;
+
+    drainTextureUploads();
+    //measure the GPU and driver, not the display refresh
+    glfwSwapInterval(0);
+
+    printf("%10s | %14s %8s | %14s %8s\n", "aircraft", "instanced ms", "draws", "individual ms", "draws");
+    for (int count : counts) {
+        buildFleet(count);
+
+        double frameMs[2];
+        unsigned draws[2];
+        for (int mode = 0; mode < 2; mode++) {
+            instancedFleet = mode == 0;
+
+            renderScene();
+            glFinish();
+
+            double start = glfwGetTime();
+            for (int frame = 0; frame < frames; frame++) {
+                renderScene();
+                glfwSwapBuffers(glWindow);
+                glfwPollEvents();
+            }
+            glFinish();
+
+            frameMs[mode] = (glfwGetTime() - start) * 1000.0 / frames;
+            draws[mode] = renderQueue.GetStats().draws;
         }
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-                
-        lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-        glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
 
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "shadowMap"), 3);
+        printf("%10d | %14.2f %8u | %14.2f %8u\n", count, frameMs[0], draws[0], frameMs[1], draws[1]);
+    }
 
-        glUniformMatrix4fv(glGetUniformLocation(myCustomShader.shaderProgram, "lightSpaceTrMatrix"),
-            1,
-            GL_FALSE,
-            glm::value_ptr(computeLightSpaceTrMatrix()));
+    instancedFleet = true;
+    glfwSwapInterval(1);
+}
 
-        drawObjects(myCustomShader, false);
+//GPU time of the shadow pass drawn from the position-only streams and from the full vertices
+void runDepthStreamBenchmark() {
+    const int frames = 120;
+    const char* const modes[] = { "position stream", "full vertices" };
+
+    //re-render every static cascade, otherwise most frames only draw the airplane
+    bool cacheStatic = gps::CascadedShadowMap::cacheStatic;
+    bool depthStreams = gps::Mesh::depthStreams;
+    gps::CascadedShadowMap::cacheStatic = false;
+    glfwSwapInterval(0);
+
+    double shadowMs[2];
+    for (int mode = 0; mode < 2; mode++) {
+        gps::Mesh::depthStreams = mode == 0;
+
+        renderScene();
+        shadowPassTimer.Finish();
+        shadowPassTimer.ResetAverage();
+
+        for (int frame = 0; frame < frames; frame++) {
+            renderScene();
+            glfwSwapBuffers(glWindow);
+            glfwPollEvents();
+        }
+        shadowPassTimer.Finish();
 
-        lightShader.useShaderProgram();
+        shadowMs[mode] = shadowPassTimer.GetAverage();
+        printf("%16s | %8.3f ms shadow pass (%d cascades, %u draws)\n", modes[mode], shadowMs[mode],
+            shadowMap.GetCascadeCount(), renderQueue.GetStats().draws);
+    }
+    printf("Position-only streams: %.2fx the speed of the full vertices\n", shadowMs[0] > 0.0 ? shadowMs[1] / shadowMs[0] : 0.0);
 
-        glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    gps::Mesh::depthStreams = depthStreams;
+    gps::CascadedShadowMap::cacheStatic = cacheStatic;
+    glfwSwapInterval(1);
+}
 
-        model = lightRotation;
-        model = glm::translate(model, 1.0f * lightDir);
-        model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-        glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+//main pass GPU time and lit fragments per pixel with and without the depth prepass
+void runPrepassBenchmark() {
+    const int frames = 120;
+    const char* const modes[] = { "no prepass", "depth prepass" };
+
+    bool prepass = depthPrepass;
+    //the prepass saves texture fetches, which the placeholders would hide
+    drainTextureUploads();
+    glfwSwapInterval(0);
+
+    for (int mode = 0; mode < 2; mode++) {
+        depthPrepass = mode == 1;
+
+        renderScene();
+        mainPassTimer.Finish();
+        litSamplesPassed.Finish();
+        mainPassTimer.ResetAverage();
+        litSamplesPassed.ResetAverage();
+
+        for (int frame = 0; frame < frames; frame++) {
+            renderScene();
+            glfwSwapBuffers(glWindow);
+            glfwPollEvents();
+        }
+        mainPassTimer.Finish();
+        litSamplesPassed.Finish();
 
-        lightCube.Draw(lightShader);
+        printf("%14s | %8.3f ms main pass | %5.2f lit fragments per pixel\n", modes[mode],
+            mainPassTimer.GetAverage(), litFragmentsPerPixel(litSamplesPassed.GetAverage()));
+    }
+
+    depthPrepass = prepass;
+    glfwSwapInterval(1);
+}
+
+//frame time against the number of clustered point lights
+void runLightsBenchmark() {
+    const int counts[] = { 0, 100, 1000, 10000 };
+    const int frames = 60;
+
+    int lightCount = airfieldLightCount;
+    drainTextureUploads();
+    glfwSwapInterval(0);
+
+    printf("%8s | %9s | %12s | %8s | %14s\n", "lights", "frame ms", "main pass ms", "bin ms", "max per cluster");
+    for (int count : counts) {
+        buildAirfieldLights(count);
+
+        renderScene();
+        glFinish();
+        mainPassTimer.Finish();
+        mainPassTimer.ResetAverage();
+
+        double binMs = 0.0;
+        double start = glfwGetTime();
+        for (int frame = 0; frame < frames; frame++) {
+            renderScene();
+            binMs += lightClusters.GetStats().binTime;
+            glfwSwapBuffers(glWindow);
+            glfwPollEvents();
+        }
+        glFinish();
+        double frameMs = (glfwGetTime() - start) * 1000.0 / frames;
+        mainPassTimer.Finish();
+
+        printf("%8d | %9.2f | %12.3f | %8.3f | %14u\n", count, frameMs, mainPassTimer.GetAverage(), binMs / frames,
+            lightClusters.GetStats().maxClusterLights);
     }
-    mySkyBox.Draw(skyboxShader, view, projection);
+
+    buildAirfieldLights(lightCount);
+    glfwSwapInterval(1);
+}
+
+//forward against deferred shading at 1080p and 4K, for 0 to 10000 point lights
+void runDeferredBenchmark() {
+    const int resolutions[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    const int counts[] = { 0, 1000, 10000 };
+    const char* const paths[] = { "forward", "deferred" };
+    const int frames = 60;
+
+    bool deferred = deferredShading;
+    int lightCount = airfieldLightCount;
+    int windowWidth, windowHeight;
+    glfwGetWindowSize(glWindow, &windowWidth, &windowHeight);
+    //forward fetches textures for every overdrawn fragment, deferred once per
+    //G-buffer sample; with 1x1 placeholders both would be nearly free
+    drainTextureUploads();
+    glfwSwapInterval(0);
+
+    printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+    printf("%11s | %8s | %6s | %9s | %12s\n", "resolution", "path", "lights", "frame ms", "main pass ms");
+    for (const int* resolution : resolutions) {
+        //the window manager may not allow the full size - report what we got
+        glfwSetWindowSize(glWindow, resolution[0], resolution[1]);
+        glfwPollEvents();
+        glfwGetFramebufferSize(glWindow, &retina_width, &retina_height);
+
+        for (int count : counts) {
+            buildAirfieldLights(count);
+
+            for (int path = 0; path < 2; path++) {
+                deferredShading = path == 1;
+
+                renderScene();
+                glFinish();
+                mainPassTimer.Finish();
+                mainPassTimer.ResetAverage();
+
+                double start = glfwGetTime();
+                for (int frame = 0; frame < frames; frame++) {
+                    renderScene();
+                    glfwSwapBuffers(glWindow);
+                    glfwPollEvents();
+                }
+                glFinish();
+                double frameMs = (glfwGetTime() - start) * 1000.0 / frames;
+                mainPassTimer.Finish();
+
+                printf("%5dx%-5d | %8s | %6d | %9.2f | %12.3f\n", retina_width, retina_height, paths[path], count,
+                    frameMs, mainPassTimer.GetAverage());
+            }
+        }
+    }
+
+    glfwSetWindowSize(glWindow, windowWidth, windowHeight);
+    glfwPollEvents();
+    glfwGetFramebufferSize(glWindow, &retina_width, &retina_height);
+    buildAirfieldLights(lightCount);
+    deferredShading = deferred;
+    glfwSwapInterval(1);
 }
 
 void cleanup() {
-    glDeleteTextures(1,& depthMapTexture);
+    //before the TextureCache and the context go away
+    gps::Model3D* models[] = { &flydubai, &cityjet, &airport, &house, &screenQuad, &lightCube };
+    for (gps::Model3D* object : models)
+        object->Release();
+    gps::GeometryArena::Instance().Release();
+    gps::GeometryArena::DepthInstance().Release();
+    shadowPassTimer.Release();
+    lightClusters.Release();
+    gBuffer.Release();
+    mainPassTimer.Release();
+    litSamplesPassed.Release();
+    shadowMap.Release();
+    glDeleteBuffers(1, &frameUniformBuffer);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteFramebuffers(1, &shadowMapFBO);
     glfwDestroyWindow(glWindow);
     glfwTerminate();
 }
 
 int main(int argc, const char * argv[]) {
+    bool instancingBenchmark = false;
+    bool depthStreamBenchmark = false;
+    bool prepassBenchmark = false;
+    bool lightsBenchmark = false;
+    bool deferredBenchmark = false;
+
+    for (int i = 1; i < argc; i++) {
+        //force the text .obj path to measure cold load times
+        if (strcmp(argv[i], "--no-mesh-cache") == 0)
+            gps::MeshCache::enabled = false;
+        //keep the exporter's triangle and vertex order
+        if (strcmp(argv[i], "--no-mesh-opt") == 0)
+            gps::MeshOptimizer::enabled = false;
+        //16 byte quantized vertices instead of 32 byte floats
+        if (strcmp(argv[i], "--packed-vertices") == 0)
+            gps::Mesh::packedVertices = true;
+        //parse .obj files with tinyobj instead of the mapped parser
+        if (strcmp(argv[i], "--tinyobj") == 0)
+            gps::ObjParser::enabled = false;
+        //bytes of texture data staged per frame
+        if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+            gps::TextureCache::uploadBudget = (size_t)atol(argv[++i]);
+        //one VAO/VBO/EBO per mesh instead of the shared arena
+        if (strcmp(argv[i], "--no-arena") == 0)
+            gps::GeometryArena::enabled = false;
+        //draw merged items one by one, as on GL 4.1
+        if (strcmp(argv[i], "--no-multi-draw") == 0)
+            gps::RenderQueue::multiDrawIndirect = false;
+        //submit every mesh in the main pass too
+        if (strcmp(argv[i], "--no-culling") == 0)
+            frustumCulling = false;
+        //shadow cascades (1-4) and their width and height in texels
+        if (strcmp(argv[i], "--cascades") == 0 && i + 1 < argc)
+            shadowCascadeCount = atoi(argv[++i]);
+        if (strcmp(argv[i], "--shadow-size") == 0 && i + 1 < argc)
+            shadowMapResolution = (GLsizei)atoi(argv[++i]);
+        //depth passes read the interleaved vertices instead of position-only copies
+        if (strcmp(argv[i], "--no-depth-stream") == 0)
+            gps::Mesh::depthStreams = false;
+        //shadow pass GPU time with and without the position-only streams, then exit
+        if (strcmp(argv[i], "--depth-stream-bench") == 0)
+            depthStreamBenchmark = true;
+        //start with the depth prepass on
+        if (strcmp(argv[i], "--depth-prepass") == 0)
+            depthPrepass = true;
+        //main pass GPU time with and without the depth prepass, then exit
+        if (strcmp(argv[i], "--prepass-bench") == 0)
+            prepassBenchmark = true;
+        //render the static shadow casters every frame
+        if (strcmp(argv[i], "--no-shadow-cache") == 0)
+            gps::CascadedShadowMap::cacheStatic = false;
+        //compile every shader program from source
+        if (strcmp(argv[i], "--no-program-cache") == 0)
+            gps::ProgramCache::enabled = false;
+        //check each shader program before submitting the next
+        if (strcmp(argv[i], "--serial-shaders") == 0)
+            gps::ShaderManager::parallel = false;
+        //compile and link time of every shader program
+        if (strcmp(argv[i], "--shader-times") == 0)
+            shaderTimes = true;
+        //shade through a G-buffer instead of in the geometry pass
+        if (strcmp(argv[i], "--deferred") == 0)
+            deferredShading = true;
+        //forward against deferred at 1080p and 4K, then exit
+        if (strcmp(argv[i], "--deferred-bench") == 0)
+            deferredBenchmark = true;
+        //clustered point lights in rows over the airfield
+        if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+            airfieldLightCount = atoi(argv[++i]);
+        //frame time for 0 to 10000 point lights, then exit
+        if (strcmp(argv[i], "--lights-bench") == 0)
+            lightsBenchmark = true;
+        //aircraft parked behind the airport, drawn instanced
+        if (strcmp(argv[i], "--fleet") == 0 && i + 1 < argc)
+            fleetSize = atoi(argv[++i]);
+        //instanced vs individual draws for 1 to 10000 aircraft, then exit
+        if (strcmp(argv[i], "--instancing-bench") == 0)
+            instancingBenchmark = true;
+    }
 
     if (!initOpenGLWindow()) {
         glfwTerminate();
@@ -540,14 +1446,49 @@ int main(int argc, const char * argv[]) {
     }
 
     initOpenGLState();
+    initShaders();
     initObjects();
+    initSceneBVH();
     initSkybox();
-    initShaders();
+    finishShaders();
     initUniforms();
     initFBO();
+    buildFleet(fleetSize);
+    lightClusters.Init();
+    buildAirfieldLights(airfieldLightCount);
 
     glCheckError();
 
+    if (instancingBenchmark) {
+        runInstancingBenchmark();
+        cleanup();
+        return 0;
+    }
+
+    if (depthStreamBenchmark) {
+        runDepthStreamBenchmark();
+        cleanup();
+        return 0;
+    }
+
+    if (prepassBenchmark) {
+        runPrepassBenchmark();
+        cleanup();
+        return 0;
+    }
+
+    if (lightsBenchmark) {
+        runLightsBenchmark();
+        cleanup();
+        return 0;
+    }
+
+    if (deferredBenchmark) {
+        runDeferredBenchmark();
+        cleanup();
+        return 0;
+    }
+
     float lastTimeStamp = 0;
     while (!glfwWindowShouldClose(glWindow)) {
         double currentTimeStamp = glfwGetTime();
@@ -556,6 +1497,7 @@ int main(int argc, const char * argv[]) {
         flightAngle += FLIGHT_SPEED * deltaTime;
 
         processMovement();
+        gps::TextureCache::Instance().Update();
         renderScene();      
 
         glfwPollEvents();
@@ -0,0 +1,229 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+//G-buffer, see GBuffer
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+//back from depth to eye and world space
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+
+uniform vec3 lightColor;
+
+//per-frame camera and light state shared by all programs (std140, binding 0)
+layout(std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    //light view-projection, split depth and depth bias of each shadow cascade
+    mat4 lightSpaceTrMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeBias;
+    vec3 lightDir;
+    vec3 pointLightPos;
+    int cascadeCount;
+};
+
+//compiled in by gps::Shader::getVariant: SHADOWS, POINT_LIGHTS, FOG
+
+#ifdef SHADOWS
+uniform sampler2DArray shadowMap;
+#endif
+
+#ifdef POINT_LIGHTS
+//the blinking red light at pointLightPos, black while it is off
+uniform vec3 pointLightColor;
+
+//clustered point lights, as in shaderStart.frag
+uniform samplerBuffer pointLights;
+uniform usamplerBuffer clusterLights;
+uniform usamplerBuffer lightIndices;
+uniform ivec3 clusterGrid;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterDepthSlicing;
+#endif
+
+//surface of this pixel, rebuilt from the G-buffer
+vec4 fPosEye;
+vec3 fPosWorld;
+vec3 normalEye;
+
+vec3 specular;
+float specularStrength = 0.5f;
+float shininess = 32.0f;
+vec3 ambient;
+float ambientStrength = 0.5f;
+vec3 diffuse;
+
+vec3 decodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    if (n.z < 0.0f)
+        n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    return normalize(n);
+}
+
+void computeDirLight() {
+    vec3 cameraPosEye = vec3(0.0f);
+    vec3 lightDirN = normalize(lightDir);
+    vec3 viewDirN = normalize(cameraPosEye - fPosEye.xyz);
+
+    ambient = ambientStrength * lightColor;
+    diffuse = max(dot(normalEye, lightDirN), 0.0f) * lightColor;
+
+    vec3 reflection = reflect(-lightDirN, normalEye);
+    float specCoeff = pow(max(dot(viewDirN, reflection), 0.0f), shininess);
+    specular = specularStrength * specCoeff * lightColor;
+}
+
+#ifdef SHADOWS
+float computeShadow() {
+    float viewDepth = -fPosEye.z;
+    if (viewDepth > cascadeSplits[cascadeCount - 1]) return 0.0f;
+
+    int cascade = 0;
+    while (cascade < cascadeCount - 1 && viewDepth > cascadeSplits[cascade])
+        cascade++;
+
+    vec4 fragPosLightSpace = lightSpaceTrMatrices[cascade] * vec4(fPosWorld, 1.0f);
+    vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    normalizedCoords = normalizedCoords * 0.5 + 0.5;
+
+    if (normalizedCoords.z > 1.0f) return 0.0f;
+
+    float currentDepth = normalizedCoords.z;
+    float bias = cascadeBias[cascade];
+
+    float shadow = 0.0;
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+
+    for(int x = -1; x <= 1; ++x) {
+        for(int y = -1; y <= 1; ++y) {
+            float pcfDepth = texture(shadowMap, vec3(normalizedCoords.xy + vec2(x, y) * texelSize, cascade)).r;
+            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+        }
+    }
+    shadow /= 9.0;
+    return shadow;
+}
+#endif
+
+#ifdef POINT_LIGHTS
+void computePointLight(vec3 color) {
+    vec3 cameraPosEye = vec3(0.0f);
+    vec4 lightPosEye = view * vec4(pointLightPos, 1.0f);
+
+    vec3 lightDirN = normalize(lightPosEye.xyz - fPosEye.xyz);
+    vec3 viewDirN = normalize(cameraPosEye - fPosEye.xyz);
+    vec3 halfVector = normalize(lightDirN + viewDirN);
+
+    float constant = 1.0f;
+    float linear = 0.09f;
+    float quadratic = 0.032f;
+    float dist = length(lightPosEye.xyz - fPosEye.xyz);
+    float att = 1.0f / (constant + linear * dist + quadratic * (dist * dist));
+
+    ambient += att * ambientStrength * color;
+    diffuse += att * max(dot(normalEye, lightDirN), 0.0f) * color;
+
+    float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), shininess);
+    specular += att * specularStrength * specCoeff * color;
+}
+
+//one cluster grid serves both paths - gl_FragCoord is the same pixel here
+void computeClusterLights(vec3 albedo, out vec3 lightsDiffuse, out vec3 lightsSpecular) {
+    lightsDiffuse = vec3(0.0f);
+    lightsSpecular = vec3(0.0f);
+
+    float viewDepth = -fPosEye.z;
+    int slice = clamp(int(log(viewDepth) * clusterDepthSlicing.x + clusterDepthSlicing.y), 0, clusterGrid.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(0), clusterGrid.xy - 1);
+    int cluster = (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x;
+    uvec2 range = texelFetch(clusterLights, cluster).rg;
+
+    vec3 viewDirN = normalize(-fPosEye.xyz);
+
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(lightIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(pointLights, 2 * light);
+        vec3 color = texelFetch(pointLights, 2 * light + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - fPosEye.xyz;
+        float dist = length(toLight);
+        float window = clamp(1.0f - pow(dist / positionRadius.w, 4.0f), 0.0f, 1.0f);
+        float att = window * window / (dist * dist + 1.0f);
+        if (att <= 0.0f) continue;
+
+        vec3 lightDirN = toLight / dist;
+        vec3 halfVector = normalize(lightDirN + viewDirN);
+        lightsDiffuse += att * max(dot(normalEye, lightDirN), 0.0f) * color;
+        lightsSpecular += att * specularStrength * pow(max(dot(normalEye, halfVector), 0.0f), shininess) * color;
+    }
+    lightsDiffuse *= albedo;
+}
+#endif
+
+float computeFog() {
+    float fogDensity = 0.008f;
+    float fragmentDistance = length(fPosEye);
+    float fogFactor = exp(-pow(fragmentDistance * fogDensity, 2.0f));
+    return clamp(fogFactor, 0.0f, 1.0f);
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+
+    //nothing drawn here - left for the skybox
+    if (depth == 1.0f) discard;
+
+    //the lit surface's depth, so the light cube and the skybox are hidden behind it
+    gl_FragDepth = depth;
+
+    vec2 uv = (vec2(pixel) + 0.5f) / vec2(textureSize(gDepth, 0));
+    fPosEye = inverseProjection * vec4(uv * 2.0f - 1.0f, depth * 2.0f - 1.0f, 1.0f);
+    fPosEye /= fPosEye.w;
+    fPosWorld = vec3(inverseView * fPosEye);
+
+    vec4 albedoMask = texelFetch(gAlbedo, pixel, 0);
+    vec3 albedo = albedoMask.rgb;
+    normalEye = decodeNormal(texelFetch(gNormal, pixel, 0).rg);
+
+    computeDirLight();
+
+#ifdef POINT_LIGHTS
+    computePointLight(pointLightColor);
+#endif
+
+    ambient *= albedo;
+    diffuse *= albedo;
+    specular *= albedoMask.a;
+
+    vec3 lightsDiffuse = vec3(0.0f);
+    vec3 lightsSpecular = vec3(0.0f);
+#ifdef POINT_LIGHTS
+    computeClusterLights(albedo, lightsDiffuse, lightsSpecular);
+    lightsSpecular *= albedoMask.a;
+#endif
+
+#ifdef SHADOWS
+    float shadow = computeShadow();
+#else
+    float shadow = 0.0f;
+#endif
+    vec3 lighting = min((ambient + (1.0f - shadow) * diffuse) + (1.0f - shadow) * specular + lightsDiffuse + lightsSpecular, 1.0f);
+
+    vec4 resultColor = vec4(lighting, 1.0f);
+
+#ifdef FOG
+    float fogFactor = computeFog();
+    vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f);
+
+    fColor = mix(fogColor, resultColor, fogFactor);
+#else
+    fColor = resultColor;
+#endif
+}
@@ -2,10 +2,12 @@
 
 layout(location=0) in vec3 vPosition;
 
-uniform mat4 lightSpaceTrMatrix;
 uniform mat4 model;
+uniform mat4 lightSpaceTrMatrix;
+uniform vec3 meshBoundsMin;
+uniform vec3 meshBoundsExtent;
 
 void main()
 {
-	gl_Position = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+	gl_Position = lightSpaceTrMatrix * model * vec4(meshBoundsMin + vPosition * meshBoundsExtent, 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=3) in mat4 instanceModel;
+
+uniform mat4 lightSpaceTrMatrix;
+uniform vec3 meshBoundsMin;
+uniform vec3 meshBoundsExtent;
+
+void main()
+{
+    gl_Position = lightSpaceTrMatrix * instanceModel * vec4(meshBoundsMin + vPosition * meshBoundsExtent, 1.0f);
+}
@@ -0,0 +1,29 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+
+uniform mat4 model;
+uniform vec3 meshBoundsMin;
+uniform vec3 meshBoundsExtent;
+
+//per-frame camera and light state shared by all programs (std140, binding 0)
+layout(std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    //light view-projection, split depth and depth bias of each shadow cascade
+    mat4 lightSpaceTrMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeBias;
+    vec3 lightDir;
+    vec3 pointLightPos;
+    int cascadeCount;
+};
+
+//the lit pass tests GL_EQUAL against this depth - same expression as shaderStart.vert
+invariant gl_Position;
+
+void main()
+{
+    vec3 position = meshBoundsMin + vPosition * meshBoundsExtent;
+    gl_Position = projection * view * model * vec4(position, 1.0f);
+}
@@ -0,0 +1,30 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=3) in mat4 instanceModel;
+
+uniform vec3 meshBoundsMin;
+uniform vec3 meshBoundsExtent;
+
+//per-frame camera and light state shared by all programs (std140, binding 0)
+layout(std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    //light view-projection, split depth and depth bias of each shadow cascade
+    mat4 lightSpaceTrMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeBias;
+    vec3 lightDir;
+    vec3 pointLightPos;
+    int cascadeCount;
+};
+
+//same expression as shaderStartInstanced.vert
+invariant gl_Position;
+
+void main()
+{
+    vec3 position = meshBoundsMin + vPosition * meshBoundsExtent;
+    mat4 modelView = view * instanceModel;
+    gl_Position = projection * (modelView * vec4(position, 1.0f));
+}
@@ -0,0 +1,39 @@
+#version 410 core
+
+in vec3 fPosition;
+in vec3 fNormal;
+in vec2 fTexCoords;
+in vec4 fPosEye;
+in vec3 fPosWorld;
+in vec3 fTint;
+
+//see GBuffer
+layout(location=0) out vec4 gAlbedo;
+layout(location=1) out vec2 gNormal;
+
+uniform mat3 normalMatrix;
+
+uniform sampler2D diffuseTexture;
+#ifdef HAS_SPECULAR_MAP
+uniform sampler2D specularTexture;
+#endif
+
+//octahedron mapping of a unit vector to [-1, 1]^2
+vec2 encodeNormal(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    return n.z >= 0.0f ? n.xy : folded;
+}
+
+void main() {
+    vec4 texColor = texture(diffuseTexture, fTexCoords);
+
+#ifdef HAS_SPECULAR_MAP
+    //specular maps are grey, one channel is enough
+    float specularMask = texture(specularTexture, fTexCoords).r;
+#else
+    float specularMask = 0.0f;
+#endif
+    gAlbedo = vec4(texColor.rgb * fTint, specularMask);
+    gNormal = encodeNormal(normalize(normalMatrix * fNormal));
+}
@@ -0,0 +1,8 @@
+#version 410 core
+
+out vec4 fColor;
+
+//added up with GL_ONE, GL_ONE blending: red at 4 layers, yellow at 8, white at 16
+void main() {
+    fColor = vec4(0.25f, 0.125f, 0.0625f, 1.0f);
+}
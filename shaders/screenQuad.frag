@@ -8,10 +8,12 @@ in vec2 fTexCoords;
 
 out vec4 fColor;
 
-uniform sampler2D depthMap;
+uniform sampler2DArray depthMap;
+//cascade shown
+uniform int depthMapLayer;
 
 void main() 
 {    
-    fColor = vec4(vec3(texture(depthMap, fTexCoords).r), 1.0f);
+    fColor = vec4(vec3(texture(depthMap, vec3(fTexCoords, depthMapLayer)).r), 1.0f);
 
 }
@@ -10,8 +10,11 @@ layout(location=2) in vec2 vTexCoords;
 
 out vec2 fTexCoords;
 
+uniform vec3 meshBoundsMin;
+uniform vec3 meshBoundsExtent;
+
 void main() 
 {
 	fTexCoords = vTexCoords;
-	gl_Position = vec4(vPosition, 1.0f);
+	gl_Position = vec4(meshBoundsMin + vPosition * meshBoundsExtent, 1.0f);
 }
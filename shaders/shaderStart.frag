@@ -4,24 +4,54 @@ in vec3 fPosition;
 in vec3 fNormal;
 in vec2 fTexCoords;
 in vec4 fPosEye;
-in vec4 fragPosLightSpace;
+in vec3 fPosWorld;
+in vec3 fTint;
 
 out vec4 fColor;
 
 uniform mat4 model;
-uniform mat4 view;
 uniform mat3 normalMatrix;
 uniform mat3 lightDirMatrix;
 
-uniform vec3 lightDir;
 uniform vec3 lightColor;
 
+//per-frame camera and light state shared by all programs (std140, binding 0)
+layout(std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    //light view-projection, split depth and depth bias of each shadow cascade
+    mat4 lightSpaceTrMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeBias;
+    vec3 lightDir;
+    vec3 pointLightPos;
+    int cascadeCount;
+};
+
+//compiled in by gps::Shader::getVariant: HAS_SPECULAR_MAP, SHADOWS, POINT_LIGHTS, FOG
+
 uniform sampler2D diffuseTexture;
+#ifdef HAS_SPECULAR_MAP
 uniform sampler2D specularTexture;
-uniform sampler2D shadowMap;
-
-uniform int redLightStarted;
-uniform vec3 pointLightPos;        
+#endif
+#ifdef SHADOWS
+uniform sampler2DArray shadowMap;
+#endif
+
+#ifdef POINT_LIGHTS
+//the blinking red light at pointLightPos, black while it is off
+uniform vec3 pointLightColor;
+
+//clustered point lights, see LightClusters: two texels per light - view-space
+//position and radius, colour - and a (first index, count) pair per cluster
+uniform samplerBuffer pointLights;
+uniform usamplerBuffer clusterLights;
+uniform usamplerBuffer lightIndices;
+uniform ivec3 clusterGrid;
+uniform vec2 clusterTileSize;
+//depth slice = log(view depth) * x + y
+uniform vec2 clusterDepthSlicing;
+#endif
 
 vec3 specular;
 float specularStrength = 0.5f;
@@ -48,28 +78,40 @@ void computeDirLight() {
     specular = specularStrength * specCoeff * lightColor;
 }
 
+#ifdef SHADOWS
 float computeShadow() {
+    //first cascade reaching this fragment's view depth, none past the last split
+    float viewDepth = -fPosEye.z;
+    if (viewDepth > cascadeSplits[cascadeCount - 1]) return 0.0f;
+
+    int cascade = 0;
+    while (cascade < cascadeCount - 1 && viewDepth > cascadeSplits[cascade])
+        cascade++;
+
+    vec4 fragPosLightSpace = lightSpaceTrMatrices[cascade] * vec4(fPosWorld, 1.0f);
     vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     normalizedCoords = normalizedCoords * 0.5 + 0.5;
 
     if (normalizedCoords.z > 1.0f) return 0.0f;
     
     float currentDepth = normalizedCoords.z;
-    float bias = 0.005f;
+    float bias = cascadeBias[cascade];
 
     float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
     
     for(int x = -1; x <= 1; ++x) {
         for(int y = -1; y <= 1; ++y) {
-            float pcfDepth = texture(shadowMap, normalizedCoords.xy + vec2(x, y) * texelSize).r;
+            float pcfDepth = texture(shadowMap, vec3(normalizedCoords.xy + vec2(x, y) * texelSize, cascade)).r;
             shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
         }
     }
     shadow /= 9.0;
     return shadow;
 }
+#endif
 
+#ifdef POINT_LIGHTS
 void computePointLight(vec3 color) {
     vec3 cameraPosEye = vec3(0.0f);
     vec4 lightPosEye = view * vec4(pointLightPos, 1.0f);
@@ -92,6 +134,41 @@ void computePointLight(vec3 color) {
     specular += att * specularStrength * specCoeff * color;
 }
 
+//unshadowed diffuse and specular light of the lights binned into this fragment's cluster
+void computeClusterLights(vec3 texColor, out vec3 lightsDiffuse, out vec3 lightsSpecular) {
+    lightsDiffuse = vec3(0.0f);
+    lightsSpecular = vec3(0.0f);
+
+    float viewDepth = -fPosEye.z;
+    int slice = clamp(int(log(viewDepth) * clusterDepthSlicing.x + clusterDepthSlicing.y), 0, clusterGrid.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(0), clusterGrid.xy - 1);
+    int cluster = (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x;
+    uvec2 range = texelFetch(clusterLights, cluster).rg;
+
+    vec3 normalEye = normalize(normalMatrix * fNormal);
+    vec3 viewDirN = normalize(-fPosEye.xyz);
+
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(lightIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(pointLights, 2 * light);
+        vec3 color = texelFetch(pointLights, 2 * light + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - fPosEye.xyz;
+        float dist = length(toLight);
+        //inverse square, windowed to reach zero at the radius
+        float window = clamp(1.0f - pow(dist / positionRadius.w, 4.0f), 0.0f, 1.0f);
+        float att = window * window / (dist * dist + 1.0f);
+        if (att <= 0.0f) continue;
+
+        vec3 lightDirN = toLight / dist;
+        vec3 halfVector = normalize(lightDirN + viewDirN);
+        lightsDiffuse += att * max(dot(normalEye, lightDirN), 0.0f) * color;
+        lightsSpecular += att * specularStrength * pow(max(dot(normalEye, halfVector), 0.0f), shininess) * color;
+    }
+    lightsDiffuse *= texColor;
+}
+#endif
+
 float computeFog() {
     float fogDensity = 0.008f; 
     float fragmentDistance = length(fPosEye);
@@ -101,24 +178,46 @@ float computeFog() {
 
 void main() {
     vec4 texColor = texture(diffuseTexture, fTexCoords);
+    texColor.rgb *= fTint;
 
     computeDirLight();
 
-    if (redLightStarted == 1) {
-        computePointLight(vec3(1.0f, 0.0f, 0.0f)); 
-    }
+#ifdef POINT_LIGHTS
+    computePointLight(pointLightColor);
+#endif
     
     ambient *= texColor.rgb;
     diffuse *= texColor.rgb;
-    specular *= texture(specularTexture, fTexCoords).rgb;
+#ifdef HAS_SPECULAR_MAP
+    vec3 specularMap = texture(specularTexture, fTexCoords).rgb;
+#else
+    //materials without a map sample texture 0, which is black
+    vec3 specularMap = vec3(0.0f);
+#endif
+    specular *= specularMap;
     
+    vec3 lightsDiffuse = vec3(0.0f);
+    vec3 lightsSpecular = vec3(0.0f);
+#ifdef POINT_LIGHTS
+    computeClusterLights(texColor.rgb, lightsDiffuse, lightsSpecular);
+    lightsSpecular *= specularMap;
+#endif
+
+#ifdef SHADOWS
     float shadow = computeShadow();
-    vec3 lighting = min((ambient + (1.0f - shadow) * diffuse) + (1.0f - shadow) * specular, 1.0f);
+#else
+    float shadow = 0.0f;
+#endif
+    vec3 lighting = min((ambient + (1.0f - shadow) * diffuse) + (1.0f - shadow) * specular + lightsDiffuse + lightsSpecular, 1.0f);
     
     vec4 resultColor = vec4(lighting, 1.0f);
 
+#ifdef FOG
     float fogFactor = computeFog();
     vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f); 
     
     fColor = mix(fogColor, resultColor, fogFactor);
+#else
+    fColor = resultColor;
+#endif
 }
\ No newline at end of file
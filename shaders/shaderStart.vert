@@ -8,23 +8,43 @@ out vec3 fPosition;
 out vec3 fNormal;
 out vec2 fTexCoords;
 out vec4 fPosEye;
-out vec4 fragPosLightSpace; 
+out vec3 fPosWorld;
+//colour multiplier, only the instanced fleet tints its liveries
+out vec3 fTint;
 
 uniform mat3 normalMatrix;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceTrMatrix; 
+//per-frame camera and light state shared by all programs (std140, binding 0)
+layout(std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    //light view-projection, split depth and depth bias of each shadow cascade
+    mat4 lightSpaceTrMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeBias;
+    vec3 lightDir;
+    vec3 pointLightPos;
+    int cascadeCount;
+};
+//packed meshes store positions relative to their bounds
+uniform vec3 meshBoundsMin;
+uniform vec3 meshBoundsExtent;
+
+//the depth prepass must produce the same depth for GL_EQUAL
+invariant gl_Position;
 
 void main() 
 {
-    fPosition = vPosition;
+    vec3 position = meshBoundsMin + vPosition * meshBoundsExtent;
+
+    fPosition = position;
     fNormal = normalize(normalMatrix * vNormal);
     fTexCoords = vTexCoords;
+    fTint = vec3(1.0f);
     
-    fPosEye = view * model * vec4(vPosition, 1.0f);
+    fPosEye = view * model * vec4(position, 1.0f);
     
-    fragPosLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+    fPosWorld = vec3(model * vec4(position, 1.0f));
     
-    gl_Position = projection * view * model * vec4(vPosition, 1.0f);
+    gl_Position = projection * view * model * vec4(position, 1.0f);
 }
\ No newline at end of file
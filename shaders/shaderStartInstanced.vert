@@ -0,0 +1,56 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+//per-instance attributes (divisor 1), see InstanceBuffer
+layout(location=3) in mat4 instanceModel;
+layout(location=7) in float instanceLivery;
+
+out vec3 fPosition;
+out vec3 fNormal;
+out vec2 fTexCoords;
+out vec4 fPosEye;
+out vec3 fPosWorld;
+out vec3 fTint;
+
+//per-frame camera and light state shared by all programs (std140, binding 0)
+layout(std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    //light view-projection, split depth and depth bias of each shadow cascade
+    mat4 lightSpaceTrMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeBias;
+    vec3 lightDir;
+    vec3 pointLightPos;
+    int cascadeCount;
+};
+//packed meshes store positions relative to their bounds
+uniform vec3 meshBoundsMin;
+uniform vec3 meshBoundsExtent;
+
+uniform vec3 liveryTints[4];
+
+//the depth prepass must produce the same depth for GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+    vec3 position = meshBoundsMin + vPosition * meshBoundsExtent;
+    mat4 modelView = view * instanceModel;
+
+    fPosition = position;
+    //world space; the fragment shader's normalMatrix (queued with an identity
+    //model) takes it to eye space. Fleet transforms are rigid, so the upper
+    //3x3 of instanceModel stands in for its inverse transpose
+    fNormal = normalize(mat3(instanceModel) * vNormal);
+    fTexCoords = vTexCoords;
+    fTint = liveryTints[int(instanceLivery)];
+
+    fPosEye = modelView * vec4(position, 1.0f);
+
+    fPosWorld = vec3(instanceModel * vec4(position, 1.0f));
+
+    gl_Position = projection * fPosEye;
+}
@@ -4,10 +4,25 @@ layout(location=0) in vec3 vPosition;
 
 out vec4 fragPosLightSpace;
 
-uniform mat4 lightSpaceTrMatrix;
 uniform mat4 model;
+uniform int cascadeIndex;
+uniform vec3 meshBoundsMin;
+uniform vec3 meshBoundsExtent;
+
+//per-frame camera and light state shared by all programs (std140, binding 0)
+layout(std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    //light view-projection, split depth and depth bias of each shadow cascade
+    mat4 lightSpaceTrMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeBias;
+    vec3 lightDir;
+    vec3 pointLightPos;
+    int cascadeCount;
+};
 
 void main()
 {
-	gl_Position = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+	gl_Position = lightSpaceTrMatrices[cascadeIndex] * model * vec4(meshBoundsMin + vPosition * meshBoundsExtent, 1.0f);
 }
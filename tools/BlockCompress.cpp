@@ -0,0 +1,153 @@
+#include "BlockCompress.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    namespace {
+
+        uint16_t packRGB565(const float color[3]) {
+
+            int r = (int)std::lround(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+            int g = (int)std::lround(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+            int b = (int)std::lround(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+            return (uint16_t)((r << 11) | (g << 5) | b);
+        }
+
+        void unpackRGB565(uint16_t packed, float color[3]) {
+
+            color[0] = (float)((packed >> 11) & 31) * 255.0f / 31.0f;
+            color[1] = (float)((packed >> 5) & 63) * 255.0f / 63.0f;
+            color[2] = (float)(packed & 31) * 255.0f / 31.0f;
+        }
+
+        // Fits the endpoints to the principal axis of the block colours
+        void encodeBlock(const unsigned char block[16][4], unsigned char out[8]) {
+
+            float mean[3] = { 0.0f, 0.0f, 0.0f };
+            for (int i = 0; i < 16; i++)
+                for (int c = 0; c < 3; c++)
+                    mean[c] += block[i][c] / 16.0f;
+
+            float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int i = 0; i < 16; i++) {
+
+                float d[3] = { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+                cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+                cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+            }
+
+            //power iteration for the dominant eigenvector
+            float axis[3] = { 1.0f, 1.0f, 1.0f };
+            for (int iteration = 0; iteration < 8; iteration++) {
+
+                float next[3] = {
+                    cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                    cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                    cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+                };
+                float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+                if (length < 1e-6f)
+                    break;
+                for (int c = 0; c < 3; c++)
+                    axis[c] = next[c] / length;
+            }
+
+            float minProjection = 1e30f, maxProjection = -1e30f;
+            for (int i = 0; i < 16; i++) {
+
+                float projection = (block[i][0] - mean[0]) * axis[0] +
+                    (block[i][1] - mean[1]) * axis[1] +
+                    (block[i][2] - mean[2]) * axis[2];
+                minProjection = std::min(minProjection, projection);
+                maxProjection = std::max(maxProjection, projection);
+            }
+
+            float high[3], low[3];
+            for (int c = 0; c < 3; c++) {
+
+                high[c] = mean[c] + axis[c] * maxProjection;
+                low[c] = mean[c] + axis[c] * minProjection;
+            }
+
+            uint16_t color0 = packRGB565(high);
+            uint16_t color1 = packRGB565(low);
+
+            //color0 > color1 selects the opaque four colour mode
+            if (color0 < color1)
+                std::swap(color0, color1);
+
+            uint32_t indices = 0;
+            if (color0 != color1) {
+
+                float palette[4][3];
+                unpackRGB565(color0, palette[0]);
+                unpackRGB565(color1, palette[1]);
+                for (int c = 0; c < 3; c++) {
+
+                    palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+                    palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+                }
+
+                for (int i = 0; i < 16; i++) {
+
+                    int best = 0;
+                    float bestError = 1e30f;
+                    for (int p = 0; p < 4; p++) {
+
+                        float error = 0.0f;
+                        for (int c = 0; c < 3; c++) {
+
+                            float d = block[i][c] - palette[p][c];
+                            error += d * d;
+                        }
+                        if (error < bestError) {
+
+                            bestError = error;
+                            best = p;
+                        }
+                    }
+                    indices |= (uint32_t)best << (2 * i);
+                }
+            }
+
+            out[0] = (unsigned char)(color0 & 0xFF);
+            out[1] = (unsigned char)(color0 >> 8);
+            out[2] = (unsigned char)(color1 & 0xFF);
+            out[3] = (unsigned char)(color1 >> 8);
+            out[4] = (unsigned char)(indices & 0xFF);
+            out[5] = (unsigned char)((indices >> 8) & 0xFF);
+            out[6] = (unsigned char)((indices >> 16) & 0xFF);
+            out[7] = (unsigned char)(indices >> 24);
+        }
+    }
+
+    std::vector<unsigned char> CompressBC1(const unsigned char* rgba, uint32_t width, uint32_t height) {
+
+        uint32_t blocksX = (width + 3) / 4;
+        uint32_t blocksY = (height + 3) / 4;
+        std::vector<unsigned char> blocks((size_t)blocksX * blocksY * 8);
+
+        for (uint32_t by = 0; by < blocksY; by++) {
+
+            for (uint32_t bx = 0; bx < blocksX; bx++) {
+
+                unsigned char block[16][4];
+                for (uint32_t y = 0; y < 4; y++) {
+
+                    for (uint32_t x = 0; x < 4; x++) {
+
+                        uint32_t px = std::min(bx * 4 + x, width - 1);
+                        uint32_t py = std::min(by * 4 + y, height - 1);
+                        memcpy(block[y * 4 + x], rgba + ((size_t)py * width + px) * 4, 4);
+                    }
+                }
+                encodeBlock(block, &blocks[((size_t)by * blocksX + bx) * 8]);
+            }
+        }
+
+        return blocks;
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef BlockCompress_hpp
+#define BlockCompress_hpp
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Encodes tightly packed RGBA8 pixels to BC1 (DXT1) blocks, ignoring alpha.
+    // Edge blocks of images whose size is not a multiple of 4 repeat the last
+    // row/column.
+    std::vector<unsigned char> CompressBC1(const unsigned char* rgba, uint32_t width, uint32_t height);
+}
+
+#endif /* BlockCompress_hpp */
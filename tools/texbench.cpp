@@ -0,0 +1,126 @@
+// Texture decode + flip micro-benchmark.
+//
+//   texbench <dir> [dir...]
+//
+// For every .jpg/.png/.tga under the given directories, times the stages
+// of getting an image ready for upload. "before" is the old loader: decode,
+// byte-at-a-time flip, then copy into the staging buffer. "after" is the
+// current one: decode, then a single staging copy that flips as it goes.
+// The vectorised in-place flip used by texcook is reported as well.
+
+#include "../ImageUtil.hpp"
+#include "../stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Best of several runs, in milliseconds
+static double timeBest(int runs, const std::function<void()>& work) {
+
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+
+        auto start = std::chrono::steady_clock::now();
+        work();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// The flip loop the loader used before
+static void byteFlip(unsigned char* image_data, int x, int y) {
+
+    int width_in_bytes = x * 4;
+    unsigned char *top = NULL;
+    unsigned char *bottom = NULL;
+    unsigned char temp = 0;
+    int half_height = y / 2;
+
+    for (int row = 0; row < half_height; row++) {
+
+        top = image_data + row * width_in_bytes;
+        bottom = image_data + (y - row - 1) * width_in_bytes;
+
+        for (int col = 0; col < width_in_bytes; col++) {
+
+            temp = *top;
+            *top = *bottom;
+            *bottom = temp;
+            top++;
+            bottom++;
+        }
+    }
+}
+
+int main(int argc, const char* argv[]) {
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: texbench <dir> [dir...]\n");
+        return 1;
+    }
+
+    std::vector<fs::path> images;
+    for (int i = 1; i < argc; i++) {
+
+        for (const auto& entry : fs::recursive_directory_iterator(argv[i])) {
+
+            std::string extension = entry.path().extension().string();
+            if (entry.is_regular_file() && (extension == ".jpg" || extension == ".png" || extension == ".tga"))
+                images.push_back(entry.path());
+        }
+    }
+    std::sort(images.begin(), images.end());
+
+    printf("%-48s %11s %9s %9s %9s %9s %9s %9s %9s\n", "image", "size", "decode", "byteflip",
+        "simdflip", "memcpy", "flipcopy", "before", "after");
+
+    double totalBefore = 0.0, totalAfter = 0.0;
+    for (const fs::path& path : images) {
+
+        std::ifstream in(path, std::ios::binary);
+        std::vector<unsigned char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        int width, height, channels;
+        unsigned char* pixels = NULL;
+        double decode = timeBest(3, [&]() {
+            stbi_image_free(pixels);
+            pixels = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &channels, 4);
+        });
+        if (!pixels)
+            continue;
+
+        size_t rowBytes = (size_t)width * 4;
+        size_t size = rowBytes * height;
+        std::vector<unsigned char> staging(size);
+
+        double byteFlipTime = timeBest(5, [&]() { byteFlip(pixels, width, height); });
+        double simdFlipTime = timeBest(5, [&]() { gps::FlipRowsVertical(pixels, rowBytes, height); });
+        double copyTime = timeBest(5, [&]() { memcpy(staging.data(), pixels, size); });
+        double flipCopyTime = timeBest(5, [&]() {
+            gps::CopyRowsFlipped(staging.data(), pixels, rowBytes, height, 0, size);
+        });
+        stbi_image_free(pixels);
+
+        double before = decode + byteFlipTime + copyTime;
+        double after = decode + flipCopyTime;
+        totalBefore += before;
+        totalAfter += after;
+
+        char dimensions[32];
+        snprintf(dimensions, sizeof(dimensions), "%dx%d", width, height);
+        printf("%-48s %11s %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n", path.string().c_str(), dimensions,
+            decode, byteFlipTime, simdFlipTime, copyTime, flipCopyTime, before, after);
+    }
+
+    printf("total (ms): before %.2f, after %.2f\n", totalBefore, totalAfter);
+    return 0;
+}
@@ -0,0 +1,141 @@
+// Texture cooking tool - converts the images used by the scene into
+// BC1-compressed KTX2 files with precomputed mip chains.
+//
+//   texcook <objects dir> [skybox dir]
+//
+// Every map_Ka/map_Kd/map_Ks image referenced by a .mtl file under the
+// objects directory is cooked as sRGB with mips, flipped vertically like
+// the runtime loader does. Every .tga in the skybox directory is cooked
+// as linear RGB, unflipped and without mips, matching SkyBox. Output is
+// written next to the source as <image>.ktx2 and skipped when up to date.
+
+#include "BlockCompress.hpp"
+#include "../ImageUtil.hpp"
+#include "../Ktx2.hpp"
+#include "../stb_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+static bool upToDate(const fs::path& source, const fs::path& cooked) {
+
+    std::error_code ec;
+    if (!fs::exists(cooked, ec))
+        return false;
+    return fs::last_write_time(cooked, ec) >= fs::last_write_time(source, ec);
+}
+
+static bool cook(const fs::path& source, bool srgb, bool flip, bool mips) {
+
+    fs::path cooked = source.string() + ".ktx2";
+    if (upToDate(source, cooked)) {
+        printf("up to date  %s\n", source.string().c_str());
+        return true;
+    }
+
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(source.string().c_str(), &width, &height, &channels, 4);
+    if (!pixels) {
+        fprintf(stderr, "ERROR: could not load %s\n", source.string().c_str());
+        return false;
+    }
+
+    std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+
+    if (flip)
+        gps::FlipRowsVertical(level.data(), (size_t)width * 4, height);
+
+    gps::Ktx2Image image;
+    image.format = srgb ? gps::KTX2_FORMAT_BC1_RGB_SRGB : gps::KTX2_FORMAT_BC1_RGB_UNORM;
+
+    uint32_t levelWidth = width, levelHeight = height;
+    while (true) {
+
+        gps::Ktx2Level compressed;
+        compressed.width = levelWidth;
+        compressed.height = levelHeight;
+        compressed.data = gps::CompressBC1(level.data(), levelWidth, levelHeight);
+        image.levels.push_back(compressed);
+
+        if (!mips || (levelWidth == 1 && levelHeight == 1))
+            break;
+
+        level = gps::Downsample(level.data(), levelWidth, levelHeight, srgb);
+        levelWidth = std::max(1u, levelWidth / 2);
+        levelHeight = std::max(1u, levelHeight / 2);
+    }
+
+    if (!gps::WriteKtx2(cooked.string(), image)) {
+        fprintf(stderr, "ERROR: could not write %s\n", cooked.string().c_str());
+        return false;
+    }
+
+    printf("cooked      %s (%dx%d, %zu levels)\n", cooked.string().c_str(), width, height, image.levels.size());
+    return true;
+}
+
+// Collects the texture maps the loader reads from a .mtl file
+static void collectMaterialTextures(const fs::path& mtl, std::set<fs::path>& textures) {
+
+    std::ifstream in(mtl);
+    std::string line;
+    while (std::getline(in, line)) {
+
+        std::istringstream tokens(line);
+        std::string keyword, name;
+        tokens >> keyword;
+        if (keyword != "map_Ka" && keyword != "map_Kd" && keyword != "map_Ks")
+            continue;
+
+        //options such as -bm come first, the file name is the last token
+        while (tokens >> name) {
+        }
+        if (!name.empty())
+            textures.insert(mtl.parent_path() / name);
+    }
+}
+
+int main(int argc, const char* argv[]) {
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: texcook <objects dir> [skybox dir]\n");
+        return 1;
+    }
+
+    bool ok = true;
+
+    std::set<fs::path> textures;
+    for (const auto& entry : fs::recursive_directory_iterator(argv[1])) {
+
+        if (entry.is_regular_file() && entry.path().extension() == ".mtl")
+            collectMaterialTextures(entry.path(), textures);
+    }
+
+    for (const fs::path& texture : textures) {
+
+        if (!fs::exists(texture)) {
+            fprintf(stderr, "WARNING: %s is referenced but missing\n", texture.string().c_str());
+            continue;
+        }
+        ok = cook(texture, true, true, true) && ok;
+    }
+
+    if (argc > 2) {
+
+        for (const auto& entry : fs::directory_iterator(argv[2])) {
+
+            if (entry.is_regular_file() && entry.path().extension() == ".tga")
+                ok = cook(entry.path(), false, false, false) && ok;
+        }
+    }
+
+    return ok ? 0 : 1;
+}